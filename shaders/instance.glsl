@@ -0,0 +1,27 @@
+// obj::Voxel::Instance, 8 bytes
+// position: x, y, z in voxels from the origin, 10 bits each, the top 2 bits are the size as a power of two voxels
+// ids: slot in the origin table in the low 16 bits, HIDDEN for unused slots, material in the high 16
+struct Instance {
+  uint position;
+  uint ids;
+};
+
+// obj::Voxel::Origin, one per chunk
+struct Origin {
+  vec3 position;
+  float voxelSize;
+};
+
+const uint HIDDEN = 0xFFFFu;
+
+uint originOf(Instance instance) { return instance.ids & 0xFFFFu; }
+uint materialOf(Instance instance) { return instance.ids >> 16; }
+
+vec3 instanceMin(Instance instance, Origin origin) {
+  uvec3 voxel = uvec3(instance.position, instance.position >> 10, instance.position >> 20) & 0x3FFu;
+  return origin.position + vec3(voxel) * origin.voxelSize;
+}
+
+float instanceSize(Instance instance, Origin origin) {
+  return origin.voxelSize * float(1u << (instance.position >> 30));
+}
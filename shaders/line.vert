@@ -1,10 +1,10 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#include "instance.glsl"
+
 
 layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 worldPosition;
-layout(location = 2) in vec3 scale;
-layout(location = 3) in vec3 rotation;
-layout(location = 4) in vec3 colour;
+layout(location = 1) in uvec2 packedInstance;
 
 layout(location = 0) out vec3 outColor;
 
@@ -13,37 +13,17 @@ layout(set = 0, binding =0) uniform Ubo{
     vec3 lightDirection;
 } ubo;
 
-float c3 = cos(rotation.z);
-float s3 = sin(rotation.z);
-float c2 = cos(rotation.x);
-float s2 = sin(rotation.x);
-float c1 = cos(rotation.y);
-float s1 = sin(rotation.y);
-
-mat4 transformMatrix = mat4(
-    vec4(
-        scale.x* (c1* c3 + s1 * s2 * s3),
-        scale.x* (c2* s3),
-        scale.x* (c1* s2* s3 - c3 * s1),
-        0.0f
-    ),
-    vec4(
-        scale.y * (c3 * s1 * s2 - c1 * s3),
-        scale.y * (c2 * c3),
-        scale.y * (c1 * c3 * s2 + s1 * s3),
-        0.0f
-    ), 
-    vec4(
-        scale.z * (c2 * s1),
-        scale.z * (-s2),
-        scale.z * (c1 * c2),
-        0.0f
-    ),
-    vec4( worldPosition.x, worldPosition.y, worldPosition.z, 1.0f)
-);
-
+layout(set = 0, binding = 2) buffer OriginBuffer {
+    Origin origins[];
+};
 
 void main() {
-    gl_Position = ubo.view * transformMatrix * vec4(position, 1.0);
-    outColor = colour*0.5;
+    const Instance instance = Instance(packedInstance.x, packedInstance.y);
+    const Origin origin = originOf(instance) == HIDDEN ? Origin(vec3(0.0), 0.0) : origins[originOf(instance)];
+    const float size = instanceSize(instance, origin);
+    const vec3 center = instanceMin(instance, origin) + size / 2.0;
+
+    // the outline cube spans -1.01..1.01, so half the size keeps it just outside the voxel
+    gl_Position = ubo.view * vec4(center + position * size / 2.0, 1.0);
+    outColor = vec3(0.0);
 }
\ No newline at end of file
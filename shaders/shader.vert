@@ -1,4 +1,7 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#include "instance.glsl"
+
 struct Material {
     vec3 colour;
     float albedo;
@@ -7,10 +10,7 @@ struct Material {
 
 
 layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 worldPosition;
-layout(location = 2) in vec3 scale;
-layout(location = 3) in vec3 rotation;
-layout(location = 4) in uint matId;
+layout(location = 1) in uvec2 packedInstance;
 
 layout(location = 0) out vec3 outColor;
 
@@ -24,36 +24,17 @@ layout(set = 0, binding = 1) buffer MaterialBuffer {
     Material materials[];
 };
 
+layout(set = 0, binding = 2) buffer OriginBuffer {
+    Origin origins[];
+};
+
 void main() {
-    const float c3 = cos(rotation.z);
-    const float s3 = sin(rotation.z);
-    const float c2 = cos(rotation.x);
-    const float s2 = sin(rotation.x);
-    const float c1 = cos(rotation.y);
-    const float s1 = sin(rotation.y);
-
-    const mat4 transformMatrix = mat4(
-        vec4(
-            scale.x* (c1* c3 + s1 * s2 * s3),
-            scale.x* (c2* s3),
-            scale.x* (c1* s2* s3 - c3 * s1),
-            0.0f
-        ),
-        vec4(
-            scale.y * (c3 * s1 * s2 - c1 * s3),
-            scale.y * (c2 * c3),
-            scale.y * (c1 * c3 * s2 + s1 * s3),
-            0.0f
-        ), 
-        vec4(
-            scale.z * (c2 * s1),
-            scale.z * (-s2),
-            scale.z * (c1 * c2),
-            0.0f
-        ),
-        vec4( worldPosition.x, worldPosition.y, worldPosition.z, 1.0f)
-    );
-    
-    gl_Position = ubo.view * transformMatrix * vec4(position, 1.0);
-    outColor = position+vec3(0.5);//materials[modelId].colour
+    const Instance instance = Instance(packedInstance.x, packedInstance.y);
+    // unused slots collapse to a point and produce no fragments
+    const Origin origin = originOf(instance) == HIDDEN ? Origin(vec3(0.0), 0.0) : origins[originOf(instance)];
+    const float size = instanceSize(instance, origin);
+    const vec3 center = instanceMin(instance, origin) + size / 2.0;
+
+    gl_Position = ubo.view * vec4(center + position * size, 1.0);
+    outColor = position+vec3(0.5);//materials[materialOf(instance)].colour
 }
\ No newline at end of file
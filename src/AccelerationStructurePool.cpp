@@ -0,0 +1,51 @@
+#include "AccelerationStructurePool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace vc {
+	AccelerationStructurePool::Allocation AccelerationStructurePool::allocate(VkDeviceSize size) {
+		const uint32_t units = static_cast<uint32_t>(std::max<VkDeviceSize>((size + ALIGNMENT - 1) / ALIGNMENT, 1));
+
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			auto range = blocks[i].allocator.allocate(units, 0);
+			if (range) return Allocation{ .buffer = blocks[i].buffer->getVkBuffer(), .offset = range->first * ALIGNMENT, .block = i, .range = *range };
+		}
+
+		// structures bigger than a block get a block of their own size
+		const VkDeviceSize blockSize = std::max(BLOCKSIZE, units * ALIGNMENT);
+		blocks.push_back(Block{
+			.buffer = std::make_unique<Buffer>(
+				device,
+				blockSize,
+				1,
+				VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				1
+			),
+			.allocator = InstanceAllocator{ static_cast<uint32_t>(blockSize / ALIGNMENT) }
+		});
+		const uint32_t block = static_cast<uint32_t>(blocks.size() - 1);
+		auto range = blocks[block].allocator.allocate(units, 0);
+		if (!range) throw std::runtime_error("failed to allocate acceleration structure memory!");
+		return Allocation{ .buffer = blocks[block].buffer->getVkBuffer(), .offset = range->first * ALIGNMENT, .block = block, .range = *range };
+	}
+
+	void AccelerationStructurePool::free(Allocation& allocation) {
+		if (allocation.buffer == VK_NULL_HANDLE) return;
+		blocks[allocation.block].allocator.free(allocation.range);
+		allocation = {};
+	}
+
+	VkDeviceSize AccelerationStructurePool::getReserved() const {
+		VkDeviceSize reserved = 0;
+		for (auto& block : blocks) reserved += block.buffer->getBufferSize();
+		return reserved;
+	}
+
+	VkDeviceSize AccelerationStructurePool::getUsed() const {
+		VkDeviceSize used = 0;
+		for (auto& block : blocks) used += block.allocator.getUsed() * ALIGNMENT;
+		return used;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "Buffer.h"
+#include "InstanceAllocator.h"
+
+namespace vc {
+	/* Storage for acceleration structures, sub-allocated out of a few large device local buffers.
+	 * Space is handed out in units of the 256 byte offset alignment acceleration structures need, by the same
+	 * allocator the instance slots use, so creating a structure is bookkeeping instead of a device allocation.
+	 * A new block is only allocated when no existing one has room.
+	 */
+	class AccelerationStructurePool {
+	public:
+		static constexpr VkDeviceSize ALIGNMENT = 256;
+		static constexpr VkDeviceSize BLOCKSIZE = 64ull << 20;
+
+		struct Allocation {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0;
+			uint32_t block = 0;
+			InstanceAllocator::Range range{};
+		};
+
+		AccelerationStructurePool(Device& device) :device{ device } {}
+
+		AccelerationStructurePool(const AccelerationStructurePool&) = delete;
+		AccelerationStructurePool& operator=(const AccelerationStructurePool&) = delete;
+
+		Allocation allocate(VkDeviceSize size);
+		// the structure living there has to be destroyed and out of use already
+		void free(Allocation& allocation);
+
+		VkDeviceSize getReserved() const;
+		VkDeviceSize getUsed() const;
+		size_t getBlockCount() const { return blocks.size(); }
+	private:
+		struct Block {
+			std::unique_ptr<Buffer> buffer;
+			InstanceAllocator allocator;
+		};
+
+		Device& device;
+		std::vector<Block> blocks{};
+	};
+}
@@ -0,0 +1,379 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ChunkCodec.h"
+#include "ChunkTable.h"
+#include "ChunkVolume.h"
+#include "IVoxelGrid.h"
+#include "NoiseService.h"
+#include "PhysicsController.h"
+#include "VoxelOctree.h"
+
+static void perlinBenchmark() {
+	NoiseService noise{ 3241561 };
+	NoiseService::Fractal fractal{ .amplitude = 3.f, .frequency = 1.f / 16.f };
+	auto res = noise.benchmark(fractal);
+	std::cout << "reference: " << res.referenceColumnsPerSecond << " columns/s\n";
+	std::cout << "scalar: " << res.scalarColumnsPerSecond << " columns/s\n";
+	std::cout << PerlinKernel::isaName(res.isa) << ": " << res.simdColumnsPerSecond << " columns/s ("
+		<< res.simdColumnsPerSecond / res.scalarColumnsPerSecond << "x)\n";
+	std::cout << "max error: " << res.maxError << " (tolerance " << PerlinKernel::TOLERANCE << ")\n";
+}
+
+static double seconds(const std::function<void()>& f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+static void chunkTableBenchmark() {
+	// a 256x256 chunk square around the origin, touched in shuffled order like a player criss-crossing the world
+	const int side = 256;
+	std::vector<std::pair<int, int>> coords{};
+	for (int x = -side / 2; x < side / 2; x++)
+		for (int z = -side / 2; z < side / 2; z++)
+			coords.emplace_back(x, z);
+	uint32_t state = 3241561;
+	for (size_t i = coords.size() - 1; i > 0; i--) {
+		state = state * 1664525u + 1013904223u;
+		std::swap(coords[i], coords[state % (i + 1)]);
+	}
+	const double n = static_cast<double>(coords.size());
+
+	struct Payload {
+		uint32_t first;
+		uint32_t count;
+	};
+	std::map<std::pair<int, int>, Payload> map{};
+	ChunkTable<Payload> table{};
+	uint64_t mapSum = 0, tableSum = 0;
+
+	double mapInsert = seconds([&]() {
+		for (auto& c : coords) map.insert({ c, Payload{ static_cast<uint32_t>(c.first), 1 } });
+	});
+	double tableInsert = seconds([&]() {
+		for (auto& c : coords) table.insert(c.first, c.second, Payload{ static_cast<uint32_t>(c.first), 1 });
+	});
+	// every chunk looks at its 4 neighbours, a quarter of them lie outside the square
+	double mapLookup = seconds([&]() {
+		for (auto& [x, z] : coords)
+			for (auto [dx, dz] : { std::pair{ 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } }) {
+				auto it = map.find({ x + dx * side / 4, z + dz * side / 4 });
+				if (it != map.end()) mapSum += it->second.count;
+			}
+	});
+	double tableLookup = seconds([&]() {
+		for (auto& [x, z] : coords)
+			for (auto [dx, dz] : { std::pair{ 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } }) {
+				Payload* p = table.get(x + dx * side / 4, z + dz * side / 4);
+				if (p != nullptr) tableSum += p->count;
+			}
+	});
+	double mapErase = seconds([&]() {
+		for (auto& c : coords) map.erase(c);
+	});
+	double tableErase = seconds([&]() {
+		for (auto& c : coords) table.erase(c.first, c.second);
+	});
+
+	auto report = [](const char* op, double ops, double mapTime, double tableTime) {
+		std::cout << op << ": std::map " << ops / mapTime << " ops/s, ChunkTable " << ops / tableTime << " ops/s ("
+			<< mapTime / tableTime << "x)\n";
+	};
+	report("insert", n, mapInsert, tableInsert);
+	report("lookup", 4 * n, mapLookup, tableLookup);
+	report("erase", n, mapErase, tableErase);
+	if (mapSum != tableSum || !map.empty() || !table.empty())
+		std::cout << "mismatch: lookups found " << mapSum << " in std::map and " << tableSum << " in ChunkTable\n";
+}
+
+// terrain shaped like ChunkLoader's: fractal height columns carved by 3D noise, a top material over a filler
+// side x side chunks centred on the origin, chunk c sits at (c / side - side / 2, c % side - side / 2)
+static const int TOP = -96;
+static const float VOXEL = 1.f / 16.f;
+
+static std::vector<ChunkVolume> terrain(int side) {
+	NoiseService noise{ 3241561 };
+	NoiseService::Fractal heights{ .amplitude = 3.f, .frequency = 1.f / 16.f };
+	NoiseService::Fractal caves{ .octaves = 2, .amplitude = 1.5f, .frequency = 0.5f, .offset = 0 };
+	const uint32_t grass = 1, stone = 2;
+	std::vector<ChunkVolume> volumes(side * side);
+	for (int c = 0; c < side * side; c++) {
+		const int x0 = (c / side - side / 2) * ChunkVolume::SIZE, z0 = (c % side - side / 2) * ChunkVolume::SIZE;
+		for (int x = 0; x < ChunkVolume::SIZE; x++) {
+			for (int z = 0; z < ChunkVolume::SIZE; z++) {
+				float surface = noise.fractal(heights, (x0 + x) * VOXEL, (z0 + z) * VOXEL) * 1.2f;
+				bool above = true;
+				for (int y = 0; y < ChunkVolume::HEIGHT; y++) {
+					float h = (TOP + y) * VOXEL;
+					bool solid = h + surface + noise.fractal3(caves, (x0 + x) * VOXEL, h, (z0 + z) * VOXEL) > 0;
+					if (solid) volumes[c].set(x, y, z, above ? grass : stone);
+					above = !solid;
+				}
+			}
+		}
+	}
+	return volumes;
+}
+
+static void codecBenchmark() {
+	const int side = 16;
+	std::vector<ChunkVolume> volumes = terrain(side);
+
+	size_t rawBytes = 0, codecBytes = 0, memory = 0;
+	std::vector<std::vector<uint8_t>> encoded(volumes.size());
+	for (size_t i = 0; i < volumes.size(); i++) {
+		std::vector<uint8_t> raw{};
+		volumes[i].save(raw);
+		rawBytes += raw.size();
+		memory += volumes[i].getMemoryUsage();
+	}
+	const int rounds = 20;
+	double encode = seconds([&]() {
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < volumes.size(); i++) {
+				encoded[i].clear();
+				ChunkCodec::encode(volumes[i], encoded[i]);
+			}
+	});
+	for (auto& e : encoded) codecBytes += e.size();
+	std::vector<ChunkVolume> decoded(volumes.size());
+	int failed = 0;
+	double decode = seconds([&]() {
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < volumes.size(); i++)
+				failed += !ChunkCodec::decode(encoded[i].data(), encoded[i].size(), decoded[i]);
+	});
+	int mismatches = 0;
+	for (size_t i = 0; i < volumes.size(); i++)
+		for (int x = 0; x < ChunkVolume::SIZE; x++)
+			for (int z = 0; z < ChunkVolume::SIZE; z++)
+				for (int y = 0; y < ChunkVolume::HEIGHT; y++)
+					mismatches += decoded[i].get(x, y, z) != volumes[i].get(x, y, z);
+
+	const double chunks = static_cast<double>(rounds * volumes.size());
+	const double megabytes = rounds * rawBytes / (1024.0 * 1024.0);
+	std::cout << volumes.size() << " chunks: raw " << rawBytes / volumes.size() << " B, encoded " << codecBytes / volumes.size()
+		<< " B per chunk (" << static_cast<double>(rawBytes) / codecBytes << "x smaller, " << static_cast<double>(memory) / codecBytes << "x against the dense volume in memory)\n";
+	std::cout << "encode: " << chunks / encode << " chunks/s (" << megabytes / encode << " MB/s of raw volume)\n";
+	std::cout << "decode: " << chunks / decode << " chunks/s (" << megabytes / decode << " MB/s of raw volume)\n";
+	if (failed != 0 || mismatches != 0)
+		std::cout << "mismatch: " << failed << " failed decodes, " << mismatches << " wrong voxels\n";
+}
+
+// reference for VoxelOctree::raycast, visits every voxel along the ray through the dense volume
+static bool march(const ChunkVolume& volume, glm::vec3 origin, glm::vec3 direction, float maxDistance, glm::ivec3& voxel) {
+	const float INF = std::numeric_limits<float>::infinity();
+	const glm::ivec3 dims{ ChunkVolume::SIZE, ChunkVolume::HEIGHT, ChunkVolume::SIZE };
+	glm::vec3 d = direction / glm::length(direction);
+
+	float enter = 0, exit = maxDistance;
+	for (int axis = 0; axis < 3; axis++) {
+		if (d[axis] == 0) {
+			if (origin[axis] < 0 || origin[axis] >= dims[axis]) return false;
+			continue;
+		}
+		float t0 = -origin[axis] / d[axis];
+		float t1 = (dims[axis] - origin[axis]) / d[axis];
+		if (t0 > t1) std::swap(t0, t1);
+		enter = std::max(enter, t0);
+		exit = std::min(exit, t1);
+	}
+	if (enter > exit) return false;
+
+	voxel = glm::clamp(glm::ivec3(glm::floor(origin + d * (enter + 1e-4f))), glm::ivec3(0), dims - 1);
+	glm::vec3 next, step;
+	for (int axis = 0; axis < 3; axis++) {
+		step[axis] = d[axis] == 0 ? INF : 1 / std::abs(d[axis]);
+		next[axis] = d[axis] == 0 ? INF : (voxel[axis] + (d[axis] > 0) - origin[axis]) / d[axis];
+	}
+	while (true) {
+		if (volume.get(voxel.x, voxel.y, voxel.z) != ChunkVolume::AIR) return true;
+		int axis = next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+		if (next[axis] > exit) return false;
+		voxel[axis] += d[axis] > 0 ? 1 : -1;
+		if (voxel[axis] < 0 || voxel[axis] >= dims[axis]) return false;
+		next[axis] += step[axis];
+	}
+}
+
+static void octreeBenchmark() {
+	const int side = 16;
+	std::vector<ChunkVolume> volumes = terrain(side);
+
+	std::vector<VoxelOctree> octrees{};
+	octrees.reserve(volumes.size());
+	double build = seconds([&]() {
+		for (auto& volume : volumes) octrees.emplace_back(volume);
+	});
+	size_t octreeBytes = 0, denseBytes = 0;
+	for (size_t i = 0; i < volumes.size(); i++) {
+		octreeBytes += octrees[i].getMemoryUsage();
+		denseBytes += volumes[i].getMemoryUsage();
+	}
+	std::vector<ChunkVolume> dense(volumes.size());
+	double toDense = seconds([&]() {
+		for (size_t i = 0; i < octrees.size(); i++) dense[i] = octrees[i].toDense();
+	});
+	int wrong = 0;
+	for (size_t i = 0; i < volumes.size(); i++)
+		for (int x = 0; x < ChunkVolume::SIZE; x++)
+			for (int z = 0; z < ChunkVolume::SIZE; z++)
+				for (int y = 0; y < ChunkVolume::HEIGHT; y++)
+					wrong += dense[i].get(x, y, z) != volumes[i].get(x, y, z) || octrees[i].get(x, y, z) != volumes[i].get(x, y, z);
+
+	// rays from around and above each chunk in every direction, so they cross sky, surface and caves
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 direction;
+	};
+	const int raysPerChunk = 2000;
+	const float maxDistance = 400.f;
+	uint32_t state = 3241561;
+	auto random = [&state](float min, float max) {
+		state = state * 1664525u + 1013904223u;
+		return min + (max - min) * (state >> 8) / static_cast<float>(1 << 24);
+	};
+	std::vector<Ray> rays(raysPerChunk);
+	for (auto& ray : rays) {
+		ray.origin = { random(-16.f, 24.f), random(0.f, ChunkVolume::HEIGHT + 32.f), random(-16.f, 24.f) };
+		do ray.direction = { random(-1.f, 1.f), random(-1.f, 1.f), random(-1.f, 1.f) };
+		while (glm::length(ray.direction) < 0.1f);
+	}
+	std::vector<int> octreeHits(rays.size() * volumes.size()), marchHits(rays.size() * volumes.size());
+	std::vector<glm::ivec3> octreeVoxels(octreeHits.size()), marchVoxels(marchHits.size());
+	double octreeRays = seconds([&]() {
+		for (size_t c = 0; c < octrees.size(); c++)
+			for (size_t r = 0; r < rays.size(); r++) {
+				VoxelOctree::Hit hit{};
+				octreeHits[c * rays.size() + r] = octrees[c].raycast(rays[r].origin, rays[r].direction, maxDistance, hit);
+				octreeVoxels[c * rays.size() + r] = hit.voxel;
+			}
+	});
+	double marchRays = seconds([&]() {
+		for (size_t c = 0; c < volumes.size(); c++)
+			for (size_t r = 0; r < rays.size(); r++)
+				marchHits[c * rays.size() + r] = march(volumes[c], rays[r].origin, rays[r].direction, maxDistance, marchVoxels[c * rays.size() + r]);
+	});
+	int hits = 0, mismatches = 0;
+	for (size_t i = 0; i < octreeHits.size(); i++) {
+		hits += octreeHits[i];
+		mismatches += octreeHits[i] != marchHits[i] || (octreeHits[i] && octreeVoxels[i] != marchVoxels[i]);
+	}
+
+	const double n = static_cast<double>(volumes.size()), rayCount = static_cast<double>(octreeHits.size());
+	std::cout << volumes.size() << " chunks: octree " << octreeBytes / volumes.size() << " B, dense " << denseBytes / volumes.size()
+		<< " B per chunk (" << static_cast<double>(denseBytes) / octreeBytes << "x smaller)\n";
+	std::cout << "build: " << n / build << " chunks/s, toDense: " << n / toDense << " chunks/s\n";
+	std::cout << "raycast: octree " << rayCount / octreeRays << " rays/s, dense march " << rayCount / marchRays << " rays/s ("
+		<< marchRays / octreeRays << "x), " << hits << " of " << octreeHits.size() << " hit\n";
+	if (wrong != 0 || mismatches != 0)
+		std::cout << "mismatch: " << wrong << " wrong voxels, " << mismatches << " rays disagree with the dense march\n";
+}
+
+// the terrain() square as seen by ChunkLoader, outside of it is solid like chunks that are not loaded
+class TerrainGrid : public IVoxelGrid {
+	const std::vector<ChunkVolume>& volumes;
+	int side;
+public:
+	TerrainGrid(const std::vector<ChunkVolume>& volumes, int side) :volumes{ volumes }, side{ side } {}
+	float getVoxelSize() const override { return VOXEL; }
+	bool anySolid(glm::ivec3 min, glm::ivec3 max) override {
+		const int size = ChunkVolume::SIZE, half = side * size / 2;
+		const int y0 = std::max(min.y - TOP, 0), y1 = max.y - TOP;
+		if (y1 >= ChunkVolume::HEIGHT) return true;
+		if (y1 < 0) return false;
+		if (min.x < -half || min.z < -half || max.x >= half || max.z >= half) return true;
+		for (int x = min.x; x <= max.x; x++)
+			for (int z = min.z; z <= max.z; z++) {
+				const ChunkVolume& volume = volumes[((x + half) / size) * side + (z + half) / size];
+				if (volume.anySolid((x + half) % size, (z + half) % size, y0, y1)) return true;
+			}
+		return false;
+	}
+};
+
+static void physicsBenchmark() {
+	// bodies dropped over the terrain keep walking in random directions, 10 seconds at 60 updates per second
+	const int side = 16, frames = 600;
+	const float delta = 1.f / 60.f, budget = 2.f;
+	std::vector<ChunkVolume> volumes = terrain(side);
+	TerrainGrid grid{ volumes, side };
+	const float extent = side * ChunkVolume::SIZE * VOXEL / 2 - 0.5f;
+
+	for (int count : { 100, 200, 400, 800, 1600, 3200 }) {
+		ic::PhysicsController physics{ grid, budget };
+		uint32_t state = 3241561;
+		auto random = [&state](float min, float max) {
+			state = state * 1664525u + 1013904223u;
+			return min + (max - min) * (state >> 8) / static_cast<float>(1 << 24);
+		};
+		std::vector<size_t> ids{};
+		for (int i = 0; i < count; i++)
+			ids.push_back(physics.add({ .position = { random(-extent, extent), TOP * VOXEL + 0.5f, random(-extent, extent) }, .halfExtents = { 0.2f, 0.4f, 0.2f } }));
+
+		float worst = 0;
+		int deferred = 0;
+		double total = seconds([&]() {
+			for (int f = 0; f < frames; f++) {
+				if (f % 30 == 0)
+					for (size_t id : ids) {
+						ic::PhysicsController::Body& body = physics.get(id);
+						body.velocity.x = random(-4.f, 4.f);
+						body.velocity.z = random(-4.f, 4.f);
+					}
+				physics.step(delta);
+				worst = std::max(worst, physics.getStepTime());
+				deferred = std::max(deferred, physics.getDeferred());
+			}
+		});
+		int grounded = 0, embedded = 0;
+		for (size_t id : ids) {
+			const ic::PhysicsController::Body& body = physics.get(id);
+			grounded += body.grounded;
+			glm::ivec3 min{ glm::floor((body.position - body.halfExtents) / VOXEL + 1e-3f) };
+			glm::ivec3 max{ glm::ceil((body.position + body.halfExtents) / VOXEL - 1e-3f) - 1.f };
+			embedded += grid.anySolid(min, max);
+		}
+		const double perBody = total * 1e6 / (static_cast<double>(frames) * count);
+		std::cout << count << " bodies: " << total * 1e3 / frames << " ms/frame (worst " << worst << " ms, at most " << deferred << " deferred), "
+			<< perBody << " us per body step, " << static_cast<int>(budget * 1e3 / perBody) << " fit the " << budget << " ms budget; " << grounded << " grounded\n";
+		if (embedded != 0)
+			std::cout << "mismatch: " << embedded << " bodies ended inside solid voxels\n";
+	}
+}
+
+int Benchmark::run(const std::string& filter) {
+	const std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+		{ "perlin", perlinBenchmark },
+		{ "chunktable", chunkTableBenchmark },
+		{ "codec", codecBenchmark },
+		{ "octree", octreeBenchmark },
+		{ "physics", physicsBenchmark },
+	};
+
+	int ran = 0;
+	for (auto& [name, bench] : benchmarks) {
+		if (!filter.empty() && filter != name) continue;
+		std::cout << "[" << name << "]\n";
+		bench();
+		ran++;
+	}
+	if (ran == 0) {
+		std::cerr << "Unknown benchmark " << filter << "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
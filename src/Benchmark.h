@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+
+/* CPU-side microbenchmarks, run with `Engine2 --bench [name]` before any window or device is created.
+ */
+class Benchmark {
+public:
+	Benchmark() = delete;
+	static int run(const std::string& filter);
+};
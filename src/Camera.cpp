@@ -2,6 +2,33 @@
 #include <cassert>
 #include <limits>
 namespace vc {
+  Frustum::Frustum(const glm::mat4& projectionView) {
+    const glm::vec4 row[4] = {
+      { projectionView[0][0], projectionView[1][0], projectionView[2][0], projectionView[3][0] },
+      { projectionView[0][1], projectionView[1][1], projectionView[2][1], projectionView[3][1] },
+      { projectionView[0][2], projectionView[1][2], projectionView[2][2], projectionView[3][2] },
+      { projectionView[0][3], projectionView[1][3], projectionView[2][3], projectionView[3][3] }
+    };
+    planes[0] = row[3] + row[0];
+    planes[1] = row[3] - row[0];
+    planes[2] = row[3] + row[1];
+    planes[3] = row[3] - row[1];
+    planes[4] = row[2];//depth is zero to one
+    planes[5] = row[3] - row[2];
+  }
+
+  bool Frustum::intersects(glm::vec3 min, glm::vec3 max) const {
+    for (const glm::vec4& plane : planes) {
+      // corner furthest along the normal
+      glm::vec3 corner{
+        plane.x > 0 ? max.x : min.x,
+        plane.y > 0 ? max.y : min.y,
+        plane.z > 0 ? max.z : min.z };
+      if (glm::dot(glm::vec3{ plane }, corner) + plane.w < 0) return false;
+    }
+    return true;
+  }
+
   void Camera::setOrthographicProjection(
     float left, float right, float top, float bottom, float near, float far) {
     projection = glm::mat4{ 1.0f };
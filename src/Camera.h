@@ -3,6 +3,14 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 namespace vc {
+	// planes of a projection * view matrix, normals point inside
+	struct Frustum {
+		glm::vec4 planes[6];
+
+		Frustum(const glm::mat4& projectionView);
+		bool intersects(glm::vec3 min, glm::vec3 max) const;
+	};
+
 	class Camera{
 		glm::mat4 projection{1.f};
 		glm::mat4 view{1};
@@ -15,6 +23,7 @@ namespace vc {
 
 		const glm::mat4& getProjection() const { return projection; };
 		const glm::mat4& getView() const { return view; };
+		Frustum getFrustum() const { return Frustum{ projection * view }; };
 	};
 }
 
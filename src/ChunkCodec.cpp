@@ -0,0 +1,155 @@
+#include "ChunkCodec.h"
+
+static void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+// false when the stream ends inside the varint or it does not fit 64 bits
+static bool readVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && data < end; shift += 7) {
+		uint8_t byte = *data++;
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) return true;
+	}
+	return false;
+}
+
+static uint64_t zigzag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+static int64_t unzigzag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+// bits needed for the largest palette index
+static int indexBits(size_t paletteSize) {
+	int bits = 0;
+	while ((size_t{ 1 } << bits) < paletteSize) bits++;
+	return bits;
+}
+
+// ChunkVolume keeps a lookup entry per material id, bounded so a corrupt stream cannot make it huge.
+// Instances carry 16 bit materials, and ChunkVolume::load takes no more either
+static const int64_t MAXMATERIAL = 1 << 16;
+
+struct Header {
+	std::vector<uint32_t> palette{};
+	int bits = 0;
+};
+
+// format version, palette size, then every material after AIR as a delta to the previous one
+static bool readHeader(const uint8_t*& data, const uint8_t* end, Header& header) {
+	if (data == end || *data++ != ChunkCodec::VERSION) return false;
+	uint64_t count;
+	if (!readVarint(data, end, count) || count == 0 || count > UINT16_MAX) return false;
+	header.palette.assign(1, ChunkVolume::AIR);
+	int64_t previous = 0;
+	for (uint64_t i = 1; i < count; i++) {
+		uint64_t delta;
+		if (!readVarint(data, end, delta)) return false;
+		previous += unzigzag(delta);
+		if (previous < 0 || previous >= MAXMATERIAL) return false;
+		header.palette.push_back(static_cast<uint32_t>(previous));
+	}
+	header.bits = indexBits(header.palette.size());
+	return true;
+}
+
+void ChunkCodec::encode(const ChunkVolume& volume, std::vector<uint8_t>& out) {
+	out.push_back(VERSION);
+	writeVarint(out, volume.palette.size());
+	int64_t previous = 0;
+	for (size_t i = 1; i < volume.palette.size(); i++) {
+		writeVarint(out, zigzag(static_cast<int64_t>(volume.palette[i]) - previous));
+		previous = volume.palette[i];
+	}
+
+	const int bits = indexBits(volume.palette.size());
+	const int perWord = 64 / volume.bits;
+	const uint64_t mask = (uint64_t{ 1 } << volume.bits) - 1;
+	// a word holding nothing but the current index extends the run without looking at its voxels
+	auto repeated = [&](uint64_t value) {
+		uint64_t word = 0;
+		for (int i = 0; i < perWord; i++) word |= value << (i * volume.bits);
+		return word;
+	};
+	uint64_t current = volume.words[0] & mask;
+	uint64_t currentWord = repeated(current);
+	uint64_t length = 0;
+	for (uint64_t word : volume.words) {
+		if (word == currentWord) {
+			length += perWord;
+			continue;
+		}
+		for (int i = 0; i < perWord; i++, word >>= volume.bits) {
+			uint64_t value = word & mask;
+			if (value != current) {
+				writeVarint(out, (length << bits) | current);
+				current = value;
+				currentWord = repeated(current);
+				length = 0;
+			}
+			length++;
+		}
+	}
+	writeVarint(out, (length << bits) | current);
+}
+
+bool ChunkCodec::decode(const uint8_t* data, size_t size, ChunkVolume& volume) {
+	volume = ChunkVolume{};
+	const uint8_t* end = data + size;
+	Header header{};
+	if (!readHeader(data, end, header)) return false;
+
+	// the stored palette is taken over as is, widened up front so no voxel is written twice
+	ChunkVolume decoded{};
+	while ((size_t{ 1 } << decoded.bits) < header.palette.size()) decoded.bits *= 2;
+	decoded.words.assign(ChunkVolume::VOLUME * decoded.bits / 64, 0);
+	decoded.palette = header.palette;
+	for (size_t i = 1; i < decoded.palette.size(); i++) {
+		uint32_t material = decoded.palette[i];
+		if (material >= decoded.lookup.size()) decoded.lookup.resize(material + 1, 0);
+		decoded.lookup[material] = static_cast<uint16_t>(i + 1);
+	}
+
+	const int perWord = 64 / decoded.bits;
+	int voxel = 0;
+	while (voxel < ChunkVolume::VOLUME) {
+		uint64_t run;
+		if (!readVarint(data, end, run)) return false;
+		uint64_t index = run & ((uint64_t{ 1 } << header.bits) - 1);
+		uint64_t length = run >> header.bits;
+		if (index >= header.palette.size() || length == 0 || length > static_cast<uint64_t>(ChunkVolume::VOLUME - voxel)) return false;
+		// most runs are air and the words start out zeroed, the rest is filled a word at a time where it can be
+		const int last = voxel + static_cast<int>(length);
+		if (index == 0) voxel = last;
+		for (; voxel < last && voxel % perWord != 0; voxel++) decoded.write(voxel, static_cast<uint32_t>(index));
+		if (voxel + perWord <= last) {
+			uint64_t word = 0;
+			for (int i = 0; i < perWord; i++) word |= index << (i * decoded.bits);
+			for (; voxel + perWord <= last; voxel += perWord) decoded.words[voxel / perWord] = word;
+		}
+		for (; voxel < last; voxel++) decoded.write(voxel, static_cast<uint32_t>(index));
+	}
+	if (data != end) return false;
+	volume = std::move(decoded);
+	return true;
+}
+
+uint32_t ChunkCodec::get(const uint8_t* data, size_t size, int x, int y, int z) {
+	const uint8_t* end = data + size;
+	Header header{};
+	if (!readHeader(data, end, header)) return ChunkVolume::AIR;
+
+	const uint64_t target = ChunkVolume::index(x, y, z);
+	uint64_t voxel = 0;
+	while (voxel < ChunkVolume::VOLUME) {
+		uint64_t run;
+		if (!readVarint(data, end, run)) break;
+		uint64_t index = run & ((uint64_t{ 1 } << header.bits) - 1);
+		voxel += run >> header.bits;
+		if (voxel > target) return index < header.palette.size() ? header.palette[index] : ChunkVolume::AIR;
+	}
+	return ChunkVolume::AIR;
+}
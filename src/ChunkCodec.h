@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ChunkVolume.h"
+
+/* Compact stream format for chunk volumes, used for region records and for idle chunks far from the camera.
+ * A stream starts with its format VERSION, streams of any other version do not decode. The palette follows
+ * as zigzag varint deltas, then the voxels as runs of one palette index in ChunkVolume order, which walks
+ * each column along y and continues into the next one. Each run is a single varint holding the run length
+ * above the index bits, so a column of air, stone and grass costs a few bytes.
+ */
+class ChunkCodec {
+public:
+	static constexpr uint8_t VERSION = 1;
+
+	ChunkCodec() = delete;
+
+	// appends the encoded volume to out
+	static void encode(const ChunkVolume& volume, std::vector<uint8_t>& out);
+	// false on malformed data, volume is left empty then
+	static bool decode(const uint8_t* data, size_t size, ChunkVolume& volume);
+	// single voxel straight from the stream without decoding the rest, AIR on malformed data
+	static uint32_t get(const uint8_t* data, size_t size, int x, int y, int z);
+};
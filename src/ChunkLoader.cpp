@@ -1,121 +1,711 @@
 #include "ChunkLoader.h"
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 #include "Material.h"
-const float ChunkLoader::CHUNKSIZE = 8;
+const float ChunkLoader::CHUNKSIZE = ChunkVolume::SIZE;
 const float ChunkLoader::VOXELSIZE = 1.f/16.f;
 static const int HEIGHT = 3;
-glm::vec2 randomGradient(int ix, int iy) {
-  // No precomputed gradients mean this works for any number of grid coordinates
-  const unsigned w = 8 * sizeof(unsigned);
-  const unsigned s = w / 2;
-  unsigned a = ix, b = iy;
-  a *= 3284157443;
+// every chunk holds CHUNKHEIGHT voxels down from TOP, enough for the lowest and highest columns
+static const int TOP = -96;
+static const int CHUNKHEIGHT = ChunkVolume::HEIGHT;
+static const int CELL = 4;//voxels per side of a coarse density cell
+static const float OVERHANG = 1.5f;//how far the 3D noise can move the surface, caves and overhangs stay within it
+ChunkLoader::Generated ChunkLoader::generateChunk(int cx, int cz, bool surfaceOnly) const{
+  Generated chunk{ .coords = std::make_pair(cx, cz), .surfaceOnly = surfaceOnly };
+  const int size = CHUNKSIZE;
+  const int x0 = cx*size;
+  const int z0 = cz*size;
+  // the volume has a one voxel apron of the neighbouring chunks so exposure can be checked across borders
+  const int span = size + 2;
+
+  // exact column heights, the density is the depth below them plus interpolated 3D noise
+  std::vector<float> surface(span*span);
+  auto column = [&](int x, int z) { return (x+1)*span + z+1; };
+  NoiseService::Fractal fractal{ .amplitude = HEIGHT, .frequency = 1.f / (2 * CHUNKSIZE) };
+  auto region = noise.region(
+    fractal,
+    (x0-1)*VOXELSIZE, (z0-1)*VOXELSIZE,
+    (x0+size)*VOXELSIZE, (z0+size)*VOXELSIZE,
+    span*span);
+  // columns are evaluated a row of PerlinKernel::WIDTH at a time
+  float xs[PerlinKernel::WIDTH], zs[PerlinKernel::WIDTH], heights[PerlinKernel::WIDTH];
+  for (int x = -1; x <= size; x++) {
+    for (int zr = -1; zr <= size; zr += PerlinKernel::WIDTH) {
+      for (int i = 0; i < PerlinKernel::WIDTH; i++) {
+        xs[i] = (x0+x)*VOXELSIZE;
+        zs[i] = (z0+std::min(zr+i, size))*VOXELSIZE; // padding lanes stay inside the region
+      }
+      noise.fractal8(region, xs, zs, heights);
+      for (int i = 0; i < PerlinKernel::WIDTH && zr + i <= size; i++)
+        surface[column(x, zr+i)] = heights[i] * 1.2f;
+    }
+  }
+
+  // 3D noise is only sampled on the corners of the cells, from the cell before the chunk to the one after it
+  NoiseService::Fractal caves{ .octaves = 2, .amplitude = OVERHANG, .frequency = 0.5f, .offset = 0 };
+  const int cellsXZ = size / CELL;
+  const int cellsY = CHUNKHEIGHT / CELL;
+  const int cornersXZ = cellsXZ + 3;
+  std::vector<float> lattice(cornersXZ*cornersXZ*(cellsY+1));
+  auto corner = [&](int x, int z, int y) -> float& { return lattice[((x+1)*cornersXZ + z+1)*(cellsY+1) + y]; };
+  for (int x = -1; x <= cellsXZ+1; x++)
+    for (int z = -1; z <= cellsXZ+1; z++)
+      for (int y = 0; y <= cellsY; y++)
+        corner(x, z, y) = noise.fractal3(caves, (x0+x*CELL)*VOXELSIZE, (TOP+y*CELL)*VOXELSIZE, (z0+z*CELL)*VOXELSIZE);
+
+  std::vector<uint8_t> solid(span*span*CHUNKHEIGHT, 0);
+  auto index = [&](int x, int z, int y) { return column(x, z)*CHUNKHEIGHT + y; };
+  for (int cellX = -1; cellX <= cellsXZ; cellX++) {
+    // cells in the apron are clipped to its single voxel
+    const int minX = std::max(cellX*CELL, -1), maxX = std::min((cellX+1)*CELL, size+1);
+    for (int cellZ = -1; cellZ <= cellsXZ; cellZ++) {
+      const int minZ = std::max(cellZ*CELL, -1), maxZ = std::min((cellZ+1)*CELL, size+1);
+      float surfaceMin = surface[column(minX, minZ)], surfaceMax = surfaceMin;
+      for (int x = minX; x < maxX; x++) {
+        for (int z = minZ; z < maxZ; z++) {
+          surfaceMin = std::min(surfaceMin, surface[column(x, z)]);
+          surfaceMax = std::max(surfaceMax, surface[column(x, z)]);
+        }
+      }
+      for (int cellY = 0; cellY < cellsY; cellY++) {
+        float c[8];
+        for (int i = 0; i < 8; i++)
+          c[i] = corner(cellX + (i&1), cellZ + ((i>>1)&1), cellY + (i>>2));
+        float noiseMin = *std::min_element(c, c+8);
+        float noiseMax = *std::max_element(c, c+8);
+
+        // trilinear values never leave the corner range, so these bound the density of the whole cell
+        float top = (TOP + cellY*CELL)*VOXELSIZE;
+        float bottom = (TOP + cellY*CELL + CELL-1)*VOXELSIZE;
+        if (top + surfaceMin + noiseMin > 0) {
+          for (int x = minX; x < maxX; x++)
+            for (int z = minZ; z < maxZ; z++)
+              std::fill_n(&solid[index(x, z, cellY*CELL)], CELL, 1);
+          continue;
+        }
+        if (bottom + surfaceMax + noiseMax <= 0) continue;
 
-  b ^= a << s | a >> w - s;
-  b *= 1911520717;
+        for (int x = minX; x < maxX; x++) {
+          float u = (float)(x - cellX*CELL) / CELL;
+          for (int z = minZ; z < maxZ; z++) {
+            float v = (float)(z - cellZ*CELL) / CELL;
+            float c00 = c[0] + (c[1]-c[0])*u, c10 = c[2] + (c[3]-c[2])*u;
+            float c01 = c[4] + (c[5]-c[4])*u, c11 = c[6] + (c[7]-c[6])*u;
+            float low = c00 + (c10-c00)*v, high = c01 + (c11-c01)*v;
+            for (int dy = 0; dy < CELL; dy++) {
+              float y = (TOP + cellY*CELL + dy)*VOXELSIZE;
+              float density = y + surface[column(x, z)] + low + (high-low)*((float)dy / CELL);
+              solid[index(x, z, cellY*CELL + dy)] = density > 0;
+            }
+          }
+        }
+      }
+    }
+  }
 
-  a ^= b << s | b >> w - s;
-  a *= 2048419325;
-  float random = a * (glm::pi<float>() / ~(~0u >> 1)); // in [0, 2*Pi]
+  // above the volume is air, below it counts as solid since nothing can see it from there
+  auto air = [&](int x, int z, int y) { return y < 0 || (y < CHUNKHEIGHT && !solid[index(x, z, y)]); };
+  for (int x = 0; x < size; x++) {
+    for (int z = 0; z < size; z++) {
+      for (int y = 0; y < CHUNKHEIGHT; y++) {
+        if (!solid[index(x, z, y)]) continue;
+        uint32_t material = air(x, z, y-1) ? vc::Material::GREEN.getId() : vc::Material::RED.getId();
+        chunk.volume.set(x, y, z, material);
 
-  return glm::vec2{sin(random), cos(random)};
+        bool exposed = air(x, z, y-1) || air(x, z, y+1) ||
+          air(x-1, z, y) || air(x+1, z, y) || air(x, z-1, y) || air(x, z+1, y);
+        if (surfaceOnly && !exposed) continue;
+        chunk.instances.emplace_back(glm::ivec3{ x, y, z }, material);
+      }
+    }
+  }
+  return chunk;
 }
 
-// Computes the dot product of the distance and gradient vectors.
-float dotGridGradient(int ix, int iy, float x, float y) {
-  // Get gradient from integer coordinates
-  glm::vec2 gradient = randomGradient(ix, iy);
+ChunkVolume ChunkLoader::Chunk::toDense() const{
+  if (dense) return *dense;
+  if (sparse) return sparse->toDense();
+  ChunkVolume volume{};
+  ChunkCodec::decode(packed.data(), packed.size(), volume);
+  return volume;
+}
 
-  // Compute the distance vector
-  float dx = x - (float)ix;
-  float dy = y - (float)iy;
+void ChunkLoader::Chunk::store(Storage target){
+  if (storage() == target) return;
+  ChunkVolume volume = dense ? std::move(*dense) : toDense();
+  dense.reset();
+  sparse.reset();
+  packed = {};
 
-  // Compute the dot-product
-  return (dx * gradient.x + dy * gradient.y);
+  if (target == DENSE) dense.emplace(std::move(volume));
+  else if (target == SPARSE) sparse.emplace(volume);
+  else ChunkCodec::encode(volume, packed);
 }
 
-float interpolate(float a0, float a1, float w) {
-  return (a1 - a0) * (3.0 - w * 2.0) * w * w + a0;
+// record stored in the region files: header, the emitted instances, then the volume
+// records of another version are generated again, 3 added the codec's own version in front of the volume
+static const uint32_t RECORDVERSION = 3;
+struct RecordHeader{
+  uint32_t version;
+  uint32_t surfaceOnly;
+  uint32_t edited;
+  uint32_t instanceCount;
+};
+
+std::vector<uint8_t> ChunkLoader::serialize(const Generated& chunk){
+  RecordHeader header{ .version = RECORDVERSION, .surfaceOnly = chunk.surfaceOnly, .edited = chunk.edited, .instanceCount = (uint32_t)chunk.instances.size() };
+  const size_t instanceBytes = chunk.instances.size() * sizeof(obj::Voxel::Instance);
+  std::vector<uint8_t> data(sizeof(header) + instanceBytes);
+  std::memcpy(data.data(), &header, sizeof(header));
+  std::memcpy(data.data() + sizeof(header), chunk.instances.data(), instanceBytes);
+  ChunkCodec::encode(chunk.volume, data);
+  return data;
 }
 
-// Sample Perlin noise at coordinates x, y
-float perlin(float x, float y) {
+bool ChunkLoader::deserialize(const std::vector<uint8_t>& data, Generated& chunk){
+  RecordHeader header;
+  if (data.size() < sizeof(header)) return false;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.version != RECORDVERSION) return false;
+  const size_t instanceBytes = (size_t)header.instanceCount * sizeof(obj::Voxel::Instance);
+  if (data.size() < sizeof(header) + instanceBytes) return false;
+  if (!ChunkCodec::decode(data.data() + sizeof(header) + instanceBytes, data.size() - sizeof(header) - instanceBytes, chunk.volume)) return false;
+  chunk.instances.resize(header.instanceCount);
+  chunk.edited = header.edited != 0;
+  chunk.surfaceOnly = header.surfaceOnly != 0;
+  std::memcpy(chunk.instances.data(), data.data() + sizeof(header), instanceBytes);
+  return true;
+}
 
-  // Determine grid cell corner coordinates
-  int x0 = (int)x;
-  int y0 = (int)y;
-  int x1 = x0 + 1;
-  int y1 = y0 + 1;
+// records from before the version field start with the surface flag, 0 or 1, and have the edited flag right after it
+bool ChunkLoader::editedRecord(const std::vector<uint8_t>& data){
+  uint32_t words[3];
+  if (data.size() < sizeof(words)) return false;
+  std::memcpy(words, data.data(), sizeof(words));
+  return words[0] > 1 ? words[2] != 0 : words[1] != 0;
+}
 
-  // Compute Interpolation weights
-  float sx = x - (float)x0;
-  float sy = y - (float)y0;
+bool ChunkLoader::integrateChunk(Generated& generated){
+  auto [x, z] = generated.coords;
+  // workers emit full resolution instances for the region record, distant chunks are emitted again coarser,
+  // and so are records stored or generated in the other surface mode
+  const int lod = lodFor(distanceTo(x, z), 0);
+  const bool reemit = lod > 0 || generated.surfaceOnly != surfaceOnly;
+  if (reemit) {
+    std::vector<uint16_t> columns{};
+    generated.instances = emitInstances(x, z, generated.volume, 0, Chunk::CLEAN, columns, lod);
+  }
+  const uint32_t count = (uint32_t)generated.instances.size();
+  auto range = vc.allocateInstances(count, ChunkTable<Chunk>::pack(x, z));
+  // out of slots, make room from the least recently used chunks that are out of sight anyway
+  while (!range && evict(1, loadDistance) > 0)
+    range = vc.allocateInstances(count, ChunkTable<Chunk>::pack(x, z));
+  if (!range) return false;
+  const int size = ChunkVolume::SIZE;
+  auto origin = vc.addOrigin({ .position = glm::vec3{ x*size, TOP, z*size } * VOXELSIZE, .voxelSize = VOXELSIZE });
+  if (!origin) {
+    vc.freeInstances(*range);
+    return false;
+  }
 
-  // Compute and interpolate top two corners
-  float n0 = dotGridGradient(x0, y0, x, y);
-  float n1 = dotGridGradient(x1, y0, x, y);
-  float ix0 = interpolate(n0, n1, sx);
+  // emission is column by column, so the offsets follow from counting the instances of every column
+  std::vector<uint16_t> columns(Chunk::CLEAN + 1, 0);
+  for (uint32_t i = 0; i < count; i++) {
+    obj::Voxel::Instance instance = generated.instances[i];
+    glm::ivec3 voxel = instance.voxel();
+    columns[std::clamp(voxel.x*size + voxel.z, 0, Chunk::CLEAN - 1) + 1]++;
+    instance.setOrigin(*origin);
+    vc.writeInstance(range->first + i, instance);
+  }
+  for (int column = 0; column < Chunk::CLEAN; column++)
+    columns[column + 1] += columns[column];
+  chunks.insert(x, z, Chunk{ .dense = std::move(generated.volume), .instances = *range, .origin = *origin, .lod = lod, .columns = std::move(columns), .edited = generated.edited, .reemitted = reemit, .lastUsed = frame });
 
-  // Compute and interpolate bottom two corners
-  n0 = dotGridGradient(x0, y1, x, y);
-  n1 = dotGridGradient(x1, y1, x, y);
-  float ix1 = interpolate(n0, n1, sx);
+  // generated borders assume unedited neighbours and edited ones were emitted against whatever was loaded then,
+  // so where either side is edited both facing sides are emitted again
+  // chunks emitted on this thread, coarse ones, rebuilt ones or after a level change, saw air where this chunk is now, their facing side
+  // is emitted again too, the ones from the workers already assumed the generated terrain here
+  const int sides[4][2] = {//column range of the x = 0, x = size-1, z = 0 and z = size-1 sides
+    { 0, size }, { (size-1)*size, Chunk::CLEAN }, { 0, (size-1)*size + 1 }, { size-1, Chunk::CLEAN } };
+  const int facing[4][4] = {//dx, dz, side of this chunk, side of the neighbour
+    { -1, 0, 0, 1 }, { 1, 0, 1, 0 }, { 0, -1, 2, 3 }, { 0, 1, 3, 2 } };
+  for (auto [dx, dz, side, other] : facing) {
+    Chunk* neighbour = chunks.get(x+dx, z+dz);
+    if (neighbour == nullptr) continue;
+    const bool edited = neighbour->edited || generated.edited;
+    if (edited) markDirty(x, z, sides[side][0], sides[side][1]);
+    if (edited || neighbour->reemitted) markDirty(x+dx, z+dz, sides[other][0], sides[other][1], edited);
+  }
+  return true;
+}
 
-  // Final step: interpolate between the two previously interpolated values, now in y
-  float value = interpolate(ix0, ix1, sy);
+// the stored record predates the edits
+void ChunkLoader::saveEdited(int cx, int cz, const Chunk& chunk){
+  Generated edited{ .coords = std::make_pair(cx, cz), .volume = chunk.toDense(), .edited = true, .surfaceOnly = surfaceOnly };
+  std::vector<uint16_t> columns{};
+  edited.instances = emitInstances(cx, cz, edited.volume, 0, Chunk::CLEAN, columns);
+  regions.write(cx, cz, serialize(edited));
+}
 
-  return value;
+int ChunkLoader::evict(int count, int radius){
+  std::vector<std::pair<uint64_t, uint64_t>> candidates{};//last used, packed coords
+  chunks.forEach([&](int x, int z, Chunk& chunk) {
+    int dx = x - center.first, dz = z - center.second;
+    if (dx*dx + dz*dz > radius*radius)
+      candidates.emplace_back(chunk.lastUsed, ChunkTable<Chunk>::pack(x, z));
+  });
+  count = std::min(count, (int)candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+  for (int i = 0; i < count; i++) {
+    auto [x, z] = ChunkTable<Chunk>::unpack(candidates[i].second);
+    Chunk* chunk = chunks.get(x, z);
+    if (chunk->edited) saveEdited(x, z, *chunk);
+    vc.freeInstances(chunk->instances);
+    vc.freeOrigin(chunk->origin);
+    chunks.erase(x, z);
+  }
+  return count;
+}
+
+ChunkLoader::~ChunkLoader(){
+  // edits still waiting for the render thread are lost, the ones applied are only in memory until now
+  chunks.forEach([&](int x, int z, Chunk& chunk) {
+    if (chunk.edited) saveEdited(x, z, chunk);
+  });
 }
 
 bool ChunkLoader::loadChunk(int cx, int cz){
-	if(!chunks.contains(std::make_pair(cx,cz))){
-    Chunk chunk{};
-    for (int x = 0; x < CHUNKSIZE;x++) {
-      for (int z = 0; z < CHUNKSIZE; z++) {
-        float val = 0;
-        float freq = 1;
-        float amp = HEIGHT;
-        float xPos = (cx*CHUNKSIZE+x)*VOXELSIZE;
-        float zPos = (cz*CHUNKSIZE+z)*VOXELSIZE;
-        for (int i = 0; i < 12; i++) {
-          val += perlin((xPos+1000000)/2 * freq / CHUNKSIZE, (zPos+ 1000000)/2 * freq / CHUNKSIZE) * amp;
-          freq *= 2;
-          amp /= 2;
-        }
-        val *= 1.2;
-        for (float i = (1 * VOXELSIZE) - (int)(val / VOXELSIZE) * VOXELSIZE; i > -val; i -= VOXELSIZE) {
-	        obj::Voxel::Instance instance{
-            .position = glm::vec3{ xPos,i,zPos },
-            .scale = glm::vec3{ VOXELSIZE },
-            .materialID = (i - VOXELSIZE > -val) ? vc::Material::RED.getId() : vc::Material::GREEN.getId()
-          };
-          chunk.voxels.emplace_back(instance);
-          if (!vc.addInstance(instance)) return false;
+  auto coords = std::make_pair(cx, cz);
+  if (chunks.contains(cx, cz) || !pending.insert(coords).second) return false;
+  workers.submit([this, cx, cz, surfaceOnly = surfaceOnly]() {
+    // a stored chunk is preferred over generating it again
+    auto start = std::chrono::steady_clock::now();
+    Generated chunk{ .coords = std::make_pair(cx, cz) };
+    std::vector<uint8_t> data{};
+    const bool stored = regions.read(cx, cz, data);
+    if (stored && deserialize(data, chunk)) {
+      loadLatency.add(std::chrono::steady_clock::now() - start);
+    }
+    else {
+      chunk = generateChunk(cx, cz, surfaceOnly);
+      generateLatency.add(std::chrono::steady_clock::now() - start);
+      // an edited record this build cannot read is left for one that can, the generated terrain would lose the edits
+      if (!stored || !editedRecord(data)) regions.write(cx, cz, serialize(chunk));
+    }
+    std::lock_guard<std::mutex> lock{ finishedMutex };
+    finished.push_back(std::move(chunk));
+  });
+  return true;
+}
+ 
+void ChunkLoader::loadAround(glm::vec3 position, const vc::Frustum& frustum){
+  const float width = CHUNKSIZE*VOXELSIZE;
+  int cx = floor(position.x / width);
+  int cz = floor(position.z / width);
+
+  frame++;
+  center = std::make_pair(cx, cz);
+  viewer = glm::vec2{ position.x, position.z } / width;
+
+  // chunks left behind shrink to octrees and then to codec streams, the ones around the camera stay dense for cheap edits
+  chunks.forEach([&](int x, int z, Chunk& chunk) {
+    int distance = (x-cx)*(x-cx) + (z-cz)*(z-cz);
+    if (distance <= loadDistance*loadDistance) chunk.lastUsed = frame;
+    if (distance > packedDistance*packedDistance) chunk.store(Chunk::PACKED);
+    else if (distance > sparseDistance*sparseDistance) chunk.store(Chunk::SPARSE);
+    else chunk.store(Chunk::DENSE);
+    setLod(x, z, chunk, lodFor(distanceTo(x, z), chunk.lod));
+  });
+
+  evict(evictionsPerFrame, unloadDistance);
+
+  loadQueue.clear();
+  for (int x = -loadDistance; x <= loadDistance; x++) {
+    for (int z = -loadDistance; z <= loadDistance; z++) {
+      if (x*x + z*z > loadDistance*loadDistance) continue;//round cutoff
+      auto coords = std::make_pair(cx+x, cz+z);
+      if (chunks.contains(coords.first, coords.second) || pending.contains(coords)) continue;
+
+      glm::vec3 min{ coords.first*width, TOP*VOXELSIZE, coords.second*width };
+      glm::vec3 max{ min.x+width, (TOP+CHUNKHEIGHT)*VOXELSIZE, min.z+width };
+      float distance = glm::length(glm::vec2{ min.x+width/2 - position.x, min.z+width/2 - position.z });
+      loadQueue.emplace_back(frustum.intersects(min, max) ? distance/2 : distance, coords);//chunks in view count as twice as close
+    }
+  }
+  std::sort(loadQueue.begin(), loadQueue.end());
+
+  // the pool only gets a few jobs at a time so the rest can still be reordered when the camera moves
+  int free = 2 * workers.threadCount() - (int)pending.size();
+  for (int i = 0; i < free && i < (int)loadQueue.size(); i++)
+    loadChunk(loadQueue[i].second.first, loadQueue[i].second.second);
+}
+
+void ChunkLoader::integrate(float budget){
+  applyEdits();
+  auto start = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock{ finishedMutex };
+    for (auto& generated : finished)
+      ready.push_back(std::move(generated));
+    finished.clear();
+  }
+  while (!ready.empty() && std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() < budget) {
+    Generated& generated = ready.front();
+    pending.erase(generated.coords);
+    int dx = generated.coords.first - center.first, dz = generated.coords.second - center.second;
+    if (dx*dx + dz*dz > unloadDistance*unloadDistance) {//the camera moved on while it was generated
+      ready.pop_front();
+      continue;
+    }
+    // when the load radius alone does not fit in the instance buffer the chunks further out than this one make room for it,
+    // least recently used first and edited ones saved on the way; with none left it is dropped and loadAround queues it again
+    const int radius = (int)std::sqrt((float)(dx*dx + dz*dz));
+    while (!integrateChunk(generated) && evict(1, radius) > 0) {}
+    ready.pop_front();
+  }
+
+  for (auto& move : vc.compactInstances(compactionBudget)) {
+    auto [x, z] = ChunkTable<Chunk>::unpack(move.owner);
+    Chunk* chunk = chunks.get(x, z);
+    if (chunk != nullptr && chunk->instances.first == move.from.first)
+      chunk->instances.first = move.to;
+  }
+}
+
+int ChunkLoader::lodFor(float distance, int current) const{
+  auto level = [this](float distance) {
+    int lod = 0;
+    for (float threshold = (float)lodDistance; distance > threshold && lod < MAXLOD; threshold *= 2) lod++;
+    return lod;
+  };
+  return std::clamp(current, level(distance - lodHysteresis), level(distance + lodHysteresis));
+}
+
+void ChunkLoader::setLod(int cx, int cz, Chunk& chunk, int lod){
+  if (chunk.lod == lod) return;
+  chunk.lod = lod;
+  markDirty(cx, cz, 0, Chunk::CLEAN, false);//the volume is unchanged, the region record still matches
+}
+
+static int floorDiv(int a, int b){
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// one bit per cell of 2^lod voxels, set when any or all of them are
+static ChunkVolume::Column downsample(const ChunkVolume::Column& column, int lod, bool all){
+  const int cell = 1 << lod;
+  const uint64_t mask = (uint64_t{ 1 } << cell) - 1;
+  ChunkVolume::Column res{};
+  for (int i = 0; i < CHUNKHEIGHT >> lod; i++) {
+    const uint64_t bits = (column[i*cell / 64] >> (i*cell % 64)) & mask;
+    if (all ? bits == mask : bits != 0) res[i / 64] |= uint64_t{ 1 } << (i % 64);
+  }
+  return res;
+}
+
+std::vector<obj::Voxel::Instance> ChunkLoader::emitInstances(int cx, int cz, const ChunkVolume& volume, int first, int last, std::vector<uint16_t>& columns, int lod){
+  const int size = ChunkVolume::SIZE;
+  // packed neighbours are decoded once instead of walking their stream for every column on the border
+  const int sides[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+  Chunk* neighbours[4];
+  std::optional<ChunkVolume> unpacked[4];
+  for (int i = 0; i < 4; i++) {
+    neighbours[i] = chunks.get(cx + sides[i][0], cz + sides[i][1]);
+    if (neighbours[i] != nullptr && neighbours[i]->storage() == Chunk::PACKED)
+      unpacked[i].emplace(neighbours[i]->toDense());
+  }
+  // exposure is worked out on solid bit masks of whole columns, neighbours that are not loaded count as air
+  // so the voxels on the border stay visible
+  ChunkVolume::Column inner[Chunk::CLEAN];//every inner column is looked at up to five times
+  bool cached[Chunk::CLEAN] = {};
+  auto fine = [&](int x, int z) -> ChunkVolume::Column {
+    if (ChunkVolume::inside(x, 0, z)) {
+      if (!cached[x*size + z]) inner[x*size + z] = volume.solidColumn(x, z);
+      cached[x*size + z] = true;
+      return inner[x*size + z];
+    }
+    const int side = x < 0 ? 0 : x >= size ? 1 : z < 0 ? 2 : 3;
+    const int nx = x - sides[side][0]*size, nz = z - sides[side][1]*size;
+    if (unpacked[side]) return unpacked[side]->solidColumn(nx, nz);
+    if (neighbours[side] == nullptr) return {};
+    if (neighbours[side]->dense) return neighbours[side]->dense->solidColumn(nx, nz);
+    ChunkVolume::Column column{};
+    for (int y = 0; y < CHUNKHEIGHT; y++)
+      if (neighbours[side]->get(nx, y, nz) != ChunkVolume::AIR) column[y / 64] |= uint64_t{ 1 } << (y % 64);
+    return column;
+  };
+  // a cell of this chunk is solid when any voxel in it is, so coarse terrain never has holes the full resolution one does not,
+  // a cell of a neighbour only covers a face when the voxels against it are all solid, whatever level the neighbour is drawn at
+  const int cell = 1 << lod;
+  auto solid = [&](int x, int z) -> ChunkVolume::Column {
+    if (lod == 0) return fine(x, z);
+    const bool inside = ChunkVolume::inside(x*cell, 0, z*cell);
+    ChunkVolume::Column res{};
+    bool firstColumn = true;
+    for (int fx = x*cell; fx < (x+1)*cell; fx++) {
+      for (int fz = z*cell; fz < (z+1)*cell; fz++) {
+        if (!inside && (fx < -1 || fx > size || fz < -1 || fz > size)) continue;
+        ChunkVolume::Column column = fine(fx, fz);
+        for (int w = 0; w < (int)res.size(); w++)
+          res[w] = firstColumn ? column[w] : inside ? res[w] | column[w] : res[w] & column[w];
+        firstColumn = false;
+      }
+    }
+    return downsample(res, lod, !inside);
+  };
+  // the uppermost voxel of a cell gives it its material, so grass stays on top
+  auto material = [&](int x, int z, int y) {
+    int top = CHUNKHEIGHT, topX = 0, topZ = 0;
+    for (int fx = x*cell; fx < (x+1)*cell; fx++) {
+      for (int fz = z*cell; fz < (z+1)*cell; fz++) {
+        const ChunkVolume::Column& column = inner[fx*size + fz];//cached by solid
+        const uint64_t bits = (column[y*cell / 64] >> (y*cell % 64)) & ((uint64_t{ 1 } << cell) - 1);
+        if (bits != 0 && y*cell + std::countr_zero(bits) < top) {
+          top = y*cell + std::countr_zero(bits);
+          topX = fx;
+          topZ = fz;
         }
       }
     }
-    chunks.insert(std::make_pair(std::make_pair(cx,cz),std::move(chunk)));
-    return true;
-	}
+    return volume.get(topX, top, topZ);
+  };
+  const int words = (int)ChunkVolume::Column{}.size();
+  const int height = CHUNKHEIGHT >> lod;
+
+  std::vector<obj::Voxel::Instance> instances{};
+  columns.clear();
+  for (int column = first; column < last; column++) {
+    columns.push_back((uint16_t)instances.size());
+    if (column / size % cell != 0 || column % size % cell != 0) continue;
+    const int x = column / size / cell, z = column % size / cell;
+    ChunkVolume::Column center = solid(x, z), covered = center;
+    for (auto [dx, dz] : { std::pair{ -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } }) {
+      ChunkVolume::Column beside = solid(x + dx, z + dz);
+      for (int w = 0; w < words; w++) covered[w] &= beside[w];
+    }
+    // above is y-1, air over the top of the volume; below is y+1, solid under its bottom
+    for (int w = 0; w < words; w++) {
+      uint64_t above = (center[w] << 1) | (w > 0 ? center[w-1] >> 63 : 0);
+      uint64_t below = (center[w] >> 1) | (w+1 < words ? center[w+1] << 63 : 0);
+      if (w == (height-1) / 64) below |= uint64_t{ 1 } << ((height-1) % 64);
+      uint64_t emitted = surfaceOnly ? center[w] & ~(covered[w] & above & below) : center[w];
+      for (; emitted != 0; emitted &= emitted - 1) {
+        const int y = w*64 + std::countr_zero(emitted);
+        if (lod == 0) instances.emplace_back(glm::ivec3{ x, y, z }, volume.get(x, y, z));
+        else instances.emplace_back(glm::ivec3{ x, y, z } * cell, material(x, z, y), 0, lod);
+      }
+    }
+  }
+  columns.push_back((uint16_t)instances.size());
+  return instances;
 }
- 
-void ChunkLoader::loadAround(float x, float z){
-  int cx = floor(x / (CHUNKSIZE*VOXELSIZE));
-  int cz = floor(z / (CHUNKSIZE*VOXELSIZE));
-
-  for (int x = -loadDistance/2; x <= loadDistance/2;x++) {
-    for (int z = -loadDistance / 2; z <= loadDistance/2; z++) {
-    	if(!loadChunk(cx+x, cz+z)){
-        vc.clearInstances();
-        chunks = std::map<std::pair<int, int>, Chunk>{};
-        x = -loadDistance / 2;
-        z = (- loadDistance / 2)+1;
-    	}
+
+bool ChunkLoader::editVoxel(glm::ivec3 voxel, uint32_t material){
+  const int size = ChunkVolume::SIZE;
+  const int cx = floorDiv(voxel.x, size), cz = floorDiv(voxel.z, size);
+  const int x = voxel.x - cx*size, y = voxel.y - TOP, z = voxel.z - cz*size;
+  Chunk* chunk = chunks.get(cx, cz);
+  if (chunk == nullptr || y < 0 || y >= CHUNKHEIGHT) return false;
+  chunk->store(Chunk::DENSE);
+  if (chunk->dense->get(x, y, z) == material) return false;
+  chunk->dense->set(x, y, z, material);
+  chunk->edited = true;
+
+  // the voxel's column and the four beside it can gain or lose exposed voxels, in x major order they lie between x-1 and x+1
+  markDirty(cx, cz, std::max(0, (x-1)*size + z), std::min(Chunk::CLEAN, (x+1)*size + z + 1));
+  if (x == 0) markDirty(cx-1, cz, (size-1)*size + z, (size-1)*size + z + 1);
+  if (x == size-1) markDirty(cx+1, cz, z, z + 1);
+  if (z == 0) markDirty(cx, cz-1, x*size + size-1, x*size + size);
+  if (z == size-1) markDirty(cx, cz+1, x*size, x*size + 1);
+  return true;
+}
+
+void ChunkLoader::markDirty(int cx, int cz, int first, int last, bool edit){
+  Chunk* chunk = chunks.get(cx, cz);
+  if (chunk == nullptr) return;
+  if (chunk->dirtyFirst == Chunk::CLEAN) dirtyChunks.emplace_back(cx, cz);
+  chunk->dirtyFirst = std::min(chunk->dirtyFirst, first);
+  chunk->dirtyLast = std::max(chunk->dirtyLast, last);
+  if (edit) chunk->edited = true;//its instances no longer match the record either
+}
+
+bool ChunkLoader::rebuildChunk(int cx, int cz, Chunk& chunk){
+  // only the dirty columns are emitted again, the instances behind them shift by the difference
+  // cells span several columns, coarser chunks are small enough to emit whole
+  const int first = chunk.lod > 0 ? 0 : chunk.dirtyFirst, last = chunk.lod > 0 ? Chunk::CLEAN : chunk.dirtyLast;
+  std::optional<ChunkVolume> unpacked{};//neighbours of an edit are rebuilt too and may be far away
+  const ChunkVolume& volume = chunk.dense ? *chunk.dense : unpacked.emplace(chunk.toDense());
+  std::vector<uint16_t> columns{};
+  auto instances = emitInstances(cx, cz, volume, first, last, columns, chunk.lod);
+
+  const vc::InstanceAllocator::Range old = chunk.instances;
+  const uint32_t begin = chunk.columns[first], end = chunk.columns[last];
+  const uint32_t tail = old.count - end;
+  const uint32_t newEnd = begin + (uint32_t)instances.size();
+  const uint32_t count = newEnd + tail;
+  if (count <= old.count) {
+    vc.moveInstances({ old.first + end, tail }, old.first + newEnd);
+    vc.resizeInstances(chunk.instances, count);
+  }
+  else if (vc.resizeInstances(chunk.instances, count)) {
+    vc.moveInstances({ old.first + end, tail }, old.first + newEnd);
+  }
+  else {
+    auto range = vc.allocateInstances(count, ChunkTable<Chunk>::pack(cx, cz));
+    if (!range) return false;
+    vc.moveInstances({ old.first, begin }, range->first);
+    vc.moveInstances({ old.first + end, tail }, range->first + newEnd);
+    vc.freeInstances(old);
+    chunk.instances = *range;
+  }
+  for (uint32_t i = 0; i < instances.size(); i++) {
+    instances[i].setOrigin(chunk.origin);
+    vc.writeInstance(chunk.instances.first + begin + i, instances[i]);
+  }
+
+  for (int column = first + 1; column <= last; column++)
+    chunk.columns[column] = (uint16_t)(begin + columns[column - first]);
+  for (int column = last + 1; column <= Chunk::CLEAN; column++)
+    chunk.columns[column] = (uint16_t)(chunk.columns[column] + newEnd - end);
+  chunk.dirtyFirst = Chunk::CLEAN;
+  chunk.dirtyLast = 0;
+  chunk.reemitted = true;
+  return true;
+}
+
+void ChunkLoader::applyEdits(){
+  if (dirtyChunks.empty()) return;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::pair<int, int>> dirty{};
+  std::swap(dirty, dirtyChunks);
+  for (auto [x, z] : dirty) {
+    Chunk* chunk = chunks.get(x, z);
+    if (chunk == nullptr || chunk->dirtyFirst == Chunk::CLEAN) continue;
+    if (!rebuildChunk(x, z, *chunk)) dirtyChunks.emplace_back(x, z);//no room in the instance buffer, retried next frame
+  }
+  editTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t ChunkLoader::getVoxel(glm::ivec3 voxel){
+  const int size = ChunkVolume::SIZE;
+  const int cx = floorDiv(voxel.x, size), cz = floorDiv(voxel.z, size);
+  const int y = voxel.y - TOP;
+  Chunk* chunk = chunks.get(cx, cz);
+  if (chunk == nullptr || y < 0 || y >= CHUNKHEIGHT) return ChunkVolume::AIR;
+  return chunk->get(voxel.x - cx*size, y, voxel.z - cz*size);
+}
+
+bool ChunkLoader::setVoxel(glm::ivec3 voxel, uint32_t material){
+  return editVoxel(voxel, material);
+}
+
+int ChunkLoader::fillBox(glm::ivec3 min, glm::ivec3 max, uint32_t material){
+  int changed = 0;
+  for (int x = min.x; x <= max.x; x++)
+    for (int z = min.z; z <= max.z; z++)
+      for (int y = min.y; y <= max.y; y++)
+        changed += editVoxel({ x, y, z }, material);
+  return changed;
+}
+
+int ChunkLoader::carveSphere(glm::vec3 center, float radius){
+  glm::ivec3 min{ glm::floor(center - radius) }, max{ glm::floor(center + radius) };
+  int changed = 0;
+  for (int x = min.x; x <= max.x; x++)
+    for (int z = min.z; z <= max.z; z++)
+      for (int y = min.y; y <= max.y; y++)
+        if (glm::length(glm::vec3{ x, y, z } + 0.5f - center) <= radius)
+          changed += editVoxel({ x, y, z }, ChunkVolume::AIR);
+  return changed;
+}
+
+std::optional<ChunkLoader::Hit> ChunkLoader::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance){
+  return raycast(Ray{ origin, direction, maxDistance }, nullptr);
+}
+
+std::optional<ChunkLoader::Hit> ChunkLoader::raycast(const Ray& ray, ChunkTable<ChunkVolume>* unpacked){
+  const int size = ChunkVolume::SIZE;
+  const float INF = std::numeric_limits<float>::infinity();
+  // everything is walked in voxel units, t is the distance along the normalized direction
+  const glm::vec3 d = ray.direction / glm::length(ray.direction);
+  const glm::vec3 p = ray.origin / VOXELSIZE;
+  const float maxT = ray.maxDistance / VOXELSIZE;
+  glm::ivec3 voxel{ glm::floor(p) };
+  glm::ivec3 step{ 0 };
+  glm::vec3 next{ INF }, delta{ INF };//t of the next boundary on each axis, t between boundaries
+  for (int a = 0; a < 3; a++) {
+    if (d[a] == 0) continue;
+    step[a] = d[a] > 0 ? 1 : -1;
+    next[a] = ((float)voxel[a] + (d[a] > 0) - p[a]) / d[a];
+    delta[a] = std::abs(1.f / d[a]);
+  }
+
+  // the chunk is only looked up again when the walk crosses into another one
+  Chunk* chunk = nullptr;
+  const ChunkVolume* volume = nullptr;//set instead of chunk when it was decoded for the batch
+  int cx = floorDiv(voxel.x, size) + 1, cz = 0;
+  glm::ivec3 normal{ 0 };
+  float t = 0;
+  while (t <= maxT) {
+    const int y = voxel.y - TOP;
+    // above the volume going up or below it going down nothing can be hit any more
+    if ((y < 0 && d.y <= 0) || (y >= CHUNKHEIGHT && d.y >= 0)) break;
+    if (y >= 0 && y < CHUNKHEIGHT) {
+      const int vx = floorDiv(voxel.x, size), vz = floorDiv(voxel.z, size);
+      if (vx != cx || vz != cz) {
+        cx = vx;
+        cz = vz;
+        chunk = chunks.get(cx, cz);
+        volume = nullptr;
+        if (chunk != nullptr && unpacked != nullptr && chunk->storage() == Chunk::PACKED) {
+          volume = unpacked->get(cx, cz);
+          if (volume == nullptr) volume = unpacked->get(unpacked->insert(cx, cz, chunk->toDense()).first);
+        }
+      }
+      if (chunk != nullptr) {
+        uint32_t material = volume ? volume->get(voxel.x - cx*size, y, voxel.z - cz*size) : chunk->get(voxel.x - cx*size, y, voxel.z - cz*size);
+        if (material != ChunkVolume::AIR)
+          return Hit{ .voxel = voxel, .normal = normal, .distance = t * VOXELSIZE, .material = material };
+      }
     }
+
+    int axis = next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+    t = next[axis];
+    next[axis] += delta[axis];
+    voxel[axis] += step[axis];
+    normal = glm::ivec3{ 0 };
+    normal[axis] = -step[axis];
   }
-  obj::Voxel::Instance instance{
-  .position = glm::vec3{ 0,0,0,},
-  .scale = glm::vec3{ 2 },
-  .materialID = vc::Material::RED.getId()};
-  vc.addInstance(instance);
+  return std::nullopt;
+}
+
+void ChunkLoader::raycast(const std::vector<Ray>& rays, std::vector<std::optional<Hit>>& hits){
+  ChunkTable<ChunkVolume> unpacked{};
+  hits.resize(rays.size());
+  for (size_t i = 0; i < rays.size(); i++)
+    hits[i] = raycast(rays[i], &unpacked);
+}
+
+bool ChunkLoader::anySolid(glm::ivec3 min, glm::ivec3 max){
+  const int size = ChunkVolume::SIZE;
+  const int y0 = std::max(min.y - TOP, 0), y1 = max.y - TOP;
+  if (y1 >= CHUNKHEIGHT) return true;
+  if (y1 < 0) return false;
+  // candidates come straight from the chunk grid, one chunk lookup and one column span test at a time
+  for (int cx = floorDiv(min.x, size); cx <= floorDiv(max.x, size); cx++)
+    for (int cz = floorDiv(min.z, size); cz <= floorDiv(max.z, size); cz++) {
+      Chunk* chunk = chunks.get(cx, cz);
+      if (chunk == nullptr) return true;
+      const int x1 = std::min(max.x - cx*size, size-1), z1 = std::min(max.z - cz*size, size-1);
+      for (int x = std::max(min.x - cx*size, 0); x <= x1; x++)
+        for (int z = std::max(min.z - cz*size, 0); z <= z1; z++)
+          if (chunk->anySolid(x, z, y0, y1)) return true;
+    }
+  return false;
 }
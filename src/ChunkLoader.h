@@ -1,29 +1,192 @@
 #pragma once
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <set>
 
+#include "Camera.h"
+#include "ChunkCodec.h"
+#include "ChunkTable.h"
+#include "ChunkVolume.h"
 #include "imgui.h"
+#include "IVoxelGrid.h"
+#include "NoiseService.h"
+#include "RegionStore.h"
+#include "ThreadPool.h"
 #include "UIModule.h"
 #include "VisualContext.h"
+#include "VoxelOctree.h"
 
-class ChunkLoader{
+class ChunkLoader : public IVoxelGrid{
 	struct Chunk{
-		std::vector<obj::Voxel> voxels{};
+		enum Storage{ DENSE, SPARSE, PACKED };
+		std::optional<ChunkVolume> dense{};
+		std::optional<VoxelOctree> sparse{};//used instead of dense beyond sparseDistance
+		std::vector<uint8_t> packed{};//ChunkCodec stream, used beyond packedDistance
+		static constexpr int CLEAN = ChunkVolume::SIZE * ChunkVolume::SIZE;
+		vc::InstanceAllocator::Range instances{};
+		uint32_t origin = obj::Voxel::Instance::HIDDEN;//slot in the origin table the instances are placed against
+		int lod = 0;//instances are cells of 2^lod voxels per side
+		std::vector<uint16_t> columns{};//offset of each column's first instance in the range, columns are x major
+		int dirtyFirst = CLEAN, dirtyLast = 0;//columns [dirtyFirst, dirtyLast) are emitted again at the next integrate
+		bool edited = false;//differs from its region record
+		bool reemitted = false;//emitted on the render thread against the chunks loaded then, not by a worker against generated terrain
+		uint64_t lastUsed = 0;//frame the chunk was last inside loadDistance
+		Storage storage() const { return dense ? DENSE : sparse ? SPARSE : PACKED; }
+		void store(Storage target);
+		ChunkVolume toDense() const;
+		uint32_t get(int x, int y, int z) const {
+			if (dense) return dense->get(x, y, z);
+			if (sparse) return sparse->get(x, y, z);
+			return ChunkCodec::get(packed.data(), packed.size(), x, y, z);
+		}
+		bool anySolid(int x, int z, int y0, int y1) const {
+			if (dense) return dense->anySolid(x, z, y0, y1);
+			for (int y = y0; y <= y1; y++)
+				if (get(x, y, z) != ChunkVolume::AIR) return true;
+			return false;
+		}
+		size_t getMemoryUsage() const { return dense ? dense->getMemoryUsage() : sparse ? sparse->getMemoryUsage() : sizeof(Chunk) + packed.capacity(); }
+	};
+	// output of a worker, only turned into a Chunk on the render thread
+	struct Generated{
+		std::pair<int, int> coords;
+		ChunkVolume volume{};
+		std::vector<obj::Voxel::Instance> instances{};//chunk relative, placed against origin 0 until integrated
+		bool edited = false;//stored after edits instead of generated
+		bool surfaceOnly = true;//mode the instances were emitted in, the other mode is emitted again when integrated
+	};
+
+public:
+	struct Hit{
+		glm::ivec3 voxel;//voxel coordinates, like the edit API
+		glm::ivec3 normal;//face the ray entered through, zero when it started inside the voxel
+		float distance;//world units
+		uint32_t material;
+	};
+	struct Ray{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		float maxDistance;
+	};
+private:
+	struct Latency{
+		std::atomic<uint64_t> count = 0;
+		std::atomic<uint64_t> nanoseconds = 0;
+		void add(std::chrono::steady_clock::duration d) { count++; nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(); }
+		float average() const { return count ? nanoseconds / (count * 1e6f) : 0.f; }//ms
 	};
 
 	vc::VisualContext& vc;
-	std::map<std::pair<int, int>, Chunk> chunks{};
-	int loadDistance = 1;
+	NoiseService noise;
+	RegionStore regions;
+	Latency loadLatency{};
+	Latency generateLatency{};
+	ChunkTable<Chunk> chunks{};
+	std::set<std::pair<int, int>> pending{};
+	std::mutex finishedMutex{};
+	std::vector<Generated> finished{};
+	std::deque<Generated> ready{};//finished chunks waiting for a frame with budget left
+	std::vector<std::pair<float, std::pair<int, int>>> loadQueue{};//priority, coords
+	int loadDistance = 20;//radius in chunks, past lodDistance times 4 so every level of detail has a ring
+	int sparseDistance = 1;//chunks further away are kept as octrees
+	int packedDistance = 2;//chunks further away are kept compressed
+	int unloadDistance = 24;//chunks further away are evicted, larger than loadDistance so walking back and forth does not reload
+	int evictionsPerFrame = 4;
+	int lodDistance = 4;//chunks further away are emitted at half resolution, every doubling of the distance halves it again
+	float lodHysteresis = 0.5f;//chunks past a threshold before the level changes, so a chunk on it does not swap every frame
+	uint32_t compactionBudget = 4096;//instances moved into holes per frame
+	uint64_t frame = 0;
+	std::pair<int, int> center{};//chunk the camera was in at the last loadAround
+	glm::vec2 viewer{};//camera position at the last loadAround, in chunks
+	std::vector<std::pair<int, int>> dirtyChunks{};
+	float editTime = 0;//ms the last rebuild of edited chunks took
+	bool surfaceOnly = true;//only emit voxels with a face exposed to air, buried ones can never be seen
+	ThreadPool workers{};//declared last so running jobs are joined before what they touch is destroyed
 
 	static const float CHUNKSIZE;
 	static const float VOXELSIZE;
+	static const int MAXLOD = 3;//the size exponent of an instance has 2 bits
+
+	Generated generateChunk(int cx, int cz, bool surfaceOnly) const;
+	static std::vector<uint8_t> serialize(const Generated& chunk);
+	static bool deserialize(const std::vector<uint8_t>& data, Generated& chunk);
+	//also readable from records deserialize rejects, those are never written over when edited
+	static bool editedRecord(const std::vector<uint8_t>& data);
+	bool integrateChunk(Generated& generated);
+	//writes an edited chunk to its region record
+	void saveEdited(int cx, int cz, const Chunk& chunk);
+	//frees up to count chunks outside radius, least recently used first
+	int evict(int count, int radius);
+
+	//level of a chunk distance chunks away that is at level current now, it only changes once the distance is lodHysteresis past a threshold
+	int lodFor(float distance, int current) const;
+	float distanceTo(int cx, int cz) const { return glm::length(glm::vec2{ cx + 0.5f, cz + 0.5f } - viewer); }
+	//emits the whole chunk again at the new level with the next integrate
+	void setLod(int cx, int cz, Chunk& chunk, int lod);
+
+	//instances of the columns [first, last), columns gets their offsets relative to the first one
+	//above lod 0 a cell is emitted with the column of its lowest x and z, the others stay empty
+	std::vector<obj::Voxel::Instance> emitInstances(int cx, int cz, const ChunkVolume& volume, int first, int last, std::vector<uint16_t>& columns, int lod = 0);
+	bool editVoxel(glm::ivec3 voxel, uint32_t material);
+	//edit marks the chunk as differing from its region record, false when only the instances are emitted again
+	void markDirty(int cx, int cz, int first, int last, bool edit = true);
+	bool rebuildChunk(int cx, int cz, Chunk& chunk);
+	void applyEdits();
+	//unpacked caches decoded packed chunks across the rays of a batch
+	std::optional<Hit> raycast(const Ray& ray, ChunkTable<ChunkVolume>* unpacked);
 public:
-	ChunkLoader(vc::VisualContext& vc) :vc{ vc }{
+	ChunkLoader(vc::VisualContext& vc, uint32_t seed) :vc{ vc }, noise{ seed }, regions{ std::filesystem::path{ "worlds" } / std::to_string(seed) }{
 		UIModule::add([this]()
 			{
-				ImGui::Text("Chunks: %d", chunks.size());
+				size_t memory = 0;
+				int levels[MAXLOD + 1] = {};
+				chunks.forEach([&](int, int, Chunk& chunk) {
+					memory += chunk.getMemoryUsage();
+					levels[chunk.lod]++;
+				});
+				ImGui::Text("Chunks: %d (%.1f KB)", (int)chunks.size(), memory / 1024.f);
+				ImGui::Text("Chunk jobs: %d in flight, %d queued", workers.inFlight(), workers.queueDepth());
+				ImGui::Text("Chunks waiting: %d to generate, %d to integrate", (int)loadQueue.size(), (int)ready.size());
+				ImGui::Text("Chunk load %.3f ms (%d), generation %.3f ms (%d)",
+					loadLatency.average(), (int)loadLatency.count, generateLatency.average(), (int)generateLatency.count);
+				ImGui::Text("Region writes queued: %d", regions.queuedWrites());
+				ImGui::Text("Last edit rebuild: %.1f us", editTime * 1000.f);
+				ImGui::Text("Chunks by LOD: %d full, %d 2x, %d 4x, %d 8x", levels[0], levels[1], levels[2], levels[3]);
+				ImGui::SliderInt("LOD distance", &lodDistance, 1, 64);
+				// loaded chunks keep the mode they were emitted in until they are emitted again
+				if (ImGui::Checkbox("Surface voxels only", &surfaceOnly))
+					chunks.forEach([&](int x, int z, Chunk&) { markDirty(x, z, 0, Chunk::CLEAN, false); });
 			});
 	};
+	//stores the edited chunks that are still loaded, the region store finishes the writes before it goes
+	~ChunkLoader();
+	//queues the chunk for generation, false if it is already loaded or pending
 	bool loadChunk(int x, int z);
-	void loadAround(float x, float z);
+	//queues the missing chunks within loadDistance, nearest and visible first
+	void loadAround(glm::vec3 position, const vc::Frustum& frustum);
+	//moves the chunks finished by the workers into the VisualContext until budget (ms) is spent, call from the render thread
+	//edits made since the last call reach the instance buffer here as well
+	void integrate(float budget);
+
+	//edits take voxel coordinates (world position / VOXELSIZE) and only touch loaded chunks
+	//AIR outside loaded chunks
+	uint32_t getVoxel(glm::ivec3 voxel);
+	//false when nothing changed, the voxel already held material or is not in a loaded chunk
+	bool setVoxel(glm::ivec3 voxel, uint32_t material);
+	//both return the number of voxels changed
+	int fillBox(glm::ivec3 min, glm::ivec3 max, uint32_t material);
+	int carveSphere(glm::vec3 center, float radius);
+
+	//Amanatides-Woo walk through the voxel grid in world units, one step per voxel crossed, chunks that are not loaded count as air
+	std::optional<Hit> raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance);
+	//hits[i] for rays[i], packed chunks are decoded once for the whole batch
+	void raycast(const std::vector<Ray>& rays, std::vector<std::optional<Hit>>& hits);
+
+	//collision queries, chunks that are not loaded and everything below the volume block movement
+	float getVoxelSize() const override { return VOXELSIZE; }
+	bool anySolid(glm::ivec3 min, glm::ivec3 max) override;
 };
 
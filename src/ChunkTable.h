@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/* Open addressing hash table from chunk coordinates to chunk payloads.
+ * Coordinates are packed into one 64 bit key and probed linearly in a flat array, erasing shifts the
+ * following entries back so there are no tombstones. Payloads live in a separate slot array and are
+ * addressed by handles that stay valid until the chunk is erased, whatever happens to the rest of the table.
+ */
+template <typename T>
+class ChunkTable {
+public:
+	struct Handle {
+		uint32_t index = UINT32_MAX;
+		uint32_t generation = 0;
+		bool valid() const { return index != UINT32_MAX; }
+	};
+
+	static uint64_t pack(int x, int z) { return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z); }
+	static std::pair<int, int> unpack(uint64_t key) { return { static_cast<int>(key >> 32), static_cast<int>(key & UINT32_MAX) }; }
+
+	ChunkTable(size_t capacity = 64) {
+		size_t size = MINSIZE;
+		while (size < capacity * 2) size *= 2;
+		buckets.assign(size, Bucket{});
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	bool contains(int x, int z) const { return probe(pack(x, z)) != NONE; }
+
+	Handle find(int x, int z) const {
+		size_t bucket = probe(pack(x, z));
+		if (bucket == NONE) return {};
+		return handle(buckets[bucket].slot);
+	}
+
+	// nullptr once the chunk behind the handle was erased
+	T* get(Handle h) {
+		if (!h.valid() || h.index >= slots.size() || slots[h.index].generation != h.generation || !slots[h.index].value) return nullptr;
+		return &*slots[h.index].value;
+	}
+	T* get(int x, int z) { return get(find(x, z)); }
+
+	// does nothing and returns the existing handle when the chunk is already in the table
+	std::pair<Handle, bool> insert(int x, int z, T&& value) {
+		uint64_t key = pack(x, z);
+		size_t bucket = probe(key);
+		if (bucket != NONE) return { handle(buckets[bucket].slot), false };
+		if ((count + 1) * 2 > buckets.size()) grow();
+
+		uint32_t slot;
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			slot = static_cast<uint32_t>(slots.size());
+			slots.emplace_back();
+		}
+		slots[slot].key = key;
+		slots[slot].value.emplace(std::move(value));
+		place(key, slot);
+		count++;
+		return { handle(slot), true };
+	}
+
+	bool erase(int x, int z) {
+		size_t bucket = probe(pack(x, z));
+		if (bucket == NONE) return false;
+		release(buckets[bucket].slot);
+
+		// backward shift: pull every following entry that may live here closer to its home bucket
+		const size_t mask = buckets.size() - 1;
+		size_t hole = bucket;
+		for (size_t next = (hole + 1) & mask; buckets[next].slot != EMPTY; next = (next + 1) & mask) {
+			size_t home = this->home(buckets[next].key);
+			if (((next - home) & mask) >= ((next - hole) & mask)) {
+				buckets[hole] = buckets[next];
+				hole = next;
+			}
+		}
+		buckets[hole] = Bucket{};
+		count--;
+		return true;
+	}
+
+	void clear() {
+		buckets.assign(buckets.size(), Bucket{});
+		for (uint32_t i = 0; i < slots.size(); i++)
+			if (slots[i].value) release(i);
+		count = 0;
+	}
+
+	// f(x, z, T&) for every chunk, in no particular order
+	template <typename F>
+	void forEach(F&& f) {
+		for (auto& slot : slots) {
+			if (!slot.value) continue;
+			auto [x, z] = unpack(slot.key);
+			f(x, z, *slot.value);
+		}
+	}
+
+private:
+	static constexpr uint32_t EMPTY = UINT32_MAX;
+	static constexpr size_t NONE = SIZE_MAX;
+	static constexpr size_t MINSIZE = 16;
+
+	struct Bucket {
+		uint64_t key = 0;
+		uint32_t slot = EMPTY;
+	};
+	struct Slot {
+		uint64_t key = 0;
+		uint32_t generation = 0;
+		std::optional<T> value{};
+	};
+
+	std::vector<Bucket> buckets{};
+	std::vector<Slot> slots{};
+	std::vector<uint32_t> freeSlots{};
+	size_t count = 0;
+
+	// fibonacci hashing, the high bits of the product mix both coordinates
+	size_t home(uint64_t key) const { return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (buckets.size() - 1); }
+
+	Handle handle(uint32_t slot) const { return { slot, slots[slot].generation }; }
+
+	size_t probe(uint64_t key) const {
+		const size_t mask = buckets.size() - 1;
+		for (size_t i = home(key); buckets[i].slot != EMPTY; i = (i + 1) & mask)
+			if (buckets[i].key == key) return i;
+		return NONE;
+	}
+
+	void place(uint64_t key, uint32_t slot) {
+		const size_t mask = buckets.size() - 1;
+		size_t i = home(key);
+		while (buckets[i].slot != EMPTY) i = (i + 1) & mask;
+		buckets[i] = { key, slot };
+	}
+
+	void release(uint32_t slot) {
+		slots[slot].value.reset();
+		slots[slot].generation++;
+		freeSlots.push_back(slot);
+	}
+
+	void grow() {
+		std::vector<Bucket> old = std::move(buckets);
+		buckets.assign(old.size() * 2, Bucket{});
+		for (auto& bucket : old)
+			if (bucket.slot != EMPTY) place(bucket.key, bucket.slot);
+	}
+};
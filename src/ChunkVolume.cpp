@@ -0,0 +1,117 @@
+#include "ChunkVolume.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+ChunkVolume::ChunkVolume() :palette{ AIR }, words(VOLUME * 4 / 64, 0) {}
+
+void ChunkVolume::set(int x, int y, int z, uint32_t material) {
+	write(index(x, y, z), paletteIndex(material));
+}
+
+ChunkVolume::Column ChunkVolume::solidColumn(int x, int z) const {
+	// a column fills whole words at every width, so they can be read straight without index math per voxel
+	Column column{};
+	const int perWord = 64 / bits;
+	const uint64_t mask = (uint64_t{ 1 } << bits) - 1;
+	const int first = index(x, 0, z) / perWord;
+	for (int w = 0; w < HEIGHT / perWord; w++) {
+		uint64_t word = words[first + w];
+		for (int i = 0; word != 0; i++, word >>= bits) {
+			if (word & mask) {
+				const int y = w * perWord + i;
+				column[y / 64] |= uint64_t{ 1 } << (y % 64);
+			}
+		}
+	}
+	return column;
+}
+
+bool ChunkVolume::anySolid(int x, int z, int y0, int y1) const {
+	// whole words at a time, only the ends of the span need masking
+	const int perWord = 64 / bits;
+	const int last = index(x, y1, z);
+	for (int i = index(x, y0, z); i <= last;) {
+		const int offset = i % perWord;
+		const int count = std::min(perWord - offset, last - i + 1);
+		uint64_t word = words[i / perWord] >> (offset * bits);
+		if (count * bits < 64) word &= (uint64_t{ 1 } << (count * bits)) - 1;
+		if (word != 0) return true;
+		i += count;
+	}
+	return false;
+}
+
+uint32_t ChunkVolume::paletteIndex(uint32_t material) {
+	if (material == AIR) return 0;
+	if (material >= lookup.size()) lookup.resize(material + 1, 0);
+	if (lookup[material] != 0) return lookup[material] - 1;
+
+	if (palette.size() == UINT16_MAX)
+		throw std::runtime_error("chunk palette is full!");
+	if (palette.size() == (size_t{ 1 } << bits)) widen();
+	palette.push_back(material);
+	lookup[material] = static_cast<uint16_t>(palette.size());
+	return static_cast<uint32_t>(palette.size() - 1);
+}
+
+void ChunkVolume::widen() {
+	std::vector<uint32_t> values(VOLUME);
+	for (int i = 0; i < VOLUME; i++)
+		values[i] = read(i);
+	bits *= 2;
+	words.assign(VOLUME * bits / 64, 0);
+	for (int i = 0; i < VOLUME; i++)
+		write(i, values[i]);
+}
+
+size_t ChunkVolume::getMemoryUsage() const {
+	return sizeof(ChunkVolume) + palette.capacity() * sizeof(uint32_t) + lookup.capacity() * sizeof(uint16_t) + words.capacity() * sizeof(uint64_t);
+}
+
+void ChunkVolume::save(std::vector<uint8_t>& out) const {
+	const uint32_t header[2] = { static_cast<uint32_t>(bits), static_cast<uint32_t>(palette.size()) };
+	const size_t start = out.size();
+	const size_t paletteBytes = palette.size() * sizeof(uint32_t);
+	const size_t wordBytes = words.size() * sizeof(uint64_t);
+	out.resize(start + sizeof(header) + paletteBytes + wordBytes);
+	std::memcpy(out.data() + start, header, sizeof(header));
+	std::memcpy(out.data() + start + sizeof(header), palette.data(), paletteBytes);
+	std::memcpy(out.data() + start + sizeof(header) + paletteBytes, words.data(), wordBytes);
+}
+
+bool ChunkVolume::load(const uint8_t* data, size_t size) {
+	uint32_t header[2];
+	if (size < sizeof(header)) return false;
+	std::memcpy(header, data, sizeof(header));
+	const int loadedBits = static_cast<int>(header[0]);
+	if ((loadedBits != 4 && loadedBits != 8 && loadedBits != 16) || header[1] == 0 || header[1] > (1u << loadedBits)) return false;
+	const size_t paletteBytes = header[1] * sizeof(uint32_t);
+	const size_t wordBytes = static_cast<size_t>(VOLUME) * loadedBits / 64 * sizeof(uint64_t);
+	if (size != sizeof(header) + paletteBytes + wordBytes) return false;
+
+	std::vector<uint32_t> loadedPalette(header[1]);
+	std::memcpy(loadedPalette.data(), data + sizeof(header), paletteBytes);
+	if (loadedPalette[0] != AIR) return false;
+	std::vector<uint16_t> loadedLookup{};
+	for (uint32_t i = 1; i < header[1]; i++) {
+		uint32_t material = loadedPalette[i];
+		if (material == AIR || material > UINT16_MAX) return false;
+		if (material >= loadedLookup.size()) loadedLookup.resize(material + 1, 0);
+		loadedLookup[material] = static_cast<uint16_t>(i + 1);
+	}
+
+	bits = loadedBits;
+	palette = std::move(loadedPalette);
+	lookup = std::move(loadedLookup);
+	words.assign(wordBytes / sizeof(uint64_t), 0);
+	std::memcpy(words.data(), data + sizeof(header) + paletteBytes, wordBytes);
+	for (int i = 0; i < VOLUME; i++) {
+		if (read(i) >= palette.size()) {
+			*this = ChunkVolume{};
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Dense voxel grid of one chunk. Every voxel stores an index into the chunk's material palette,
+ * packed 4 bits wide and widened to 8 then 16 bits when the palette outgrows them.
+ * Palette index 0 is always AIR. Columns are contiguous along y.
+ */
+class ChunkVolume {
+	friend class ChunkCodec;
+public:
+	static constexpr int SIZE = 8;//voxels along x and z
+	static constexpr int HEIGHT = 192;//voxels along y
+	static constexpr int VOLUME = SIZE * SIZE * HEIGHT;
+	static constexpr uint32_t AIR = UINT32_MAX;
+	using Column = std::array<uint64_t, HEIGHT / 64>;//bit y is set where the voxel is not AIR
+
+	ChunkVolume();
+
+	static bool inside(int x, int y, int z) { return x >= 0 && x < SIZE && z >= 0 && z < SIZE && y >= 0 && y < HEIGHT; }
+
+	uint32_t get(int x, int y, int z) const { return palette[read(index(x, y, z))]; }
+	void set(int x, int y, int z, uint32_t material);
+	Column solidColumn(int x, int z) const;
+	// whether any voxel of column (x, z) in [y0, y1] is not AIR
+	bool anySolid(int x, int z, int y0, int y1) const;
+
+	// raw palette and packed indices, load returns false on malformed data
+	void save(std::vector<uint8_t>& out) const;
+	bool load(const uint8_t* data, size_t size);
+
+	int getBits() const { return bits; }
+	size_t getPaletteSize() const { return palette.size(); }
+	size_t getMemoryUsage() const;
+private:
+	std::vector<uint32_t> palette{};
+	std::vector<uint16_t> lookup{};//material id -> palette index + 1, material ids are small and dense
+	std::vector<uint64_t> words{};
+	int bits = 4;
+
+	static int index(int x, int y, int z) { return (x * SIZE + z) * HEIGHT + y; }
+
+	uint32_t read(int i) const {
+		const int perWord = 64 / bits;
+		return static_cast<uint32_t>(words[i / perWord] >> ((i % perWord) * bits)) & ((1u << bits) - 1);
+	}
+	void write(int i, uint32_t value) {
+		const int perWord = 64 / bits;
+		const int shift = (i % perWord) * bits;
+		const uint64_t mask = ((uint64_t{ 1 } << bits) - 1) << shift;
+		words[i / perWord] = (words[i / perWord] & ~mask) | (static_cast<uint64_t>(value) << shift);
+	}
+	uint32_t paletteIndex(uint32_t material);
+	void widen();
+};
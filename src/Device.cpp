@@ -148,6 +148,9 @@ namespace vc {
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+		if (indices.transferFamilyHasValue) {
+			uniqueQueueFamilies.insert(indices.transferFamily);
+		}
 
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -198,6 +201,12 @@ namespace vc {
 
 		vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
 		vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+		if (indices.transferFamilyHasValue) {
+			vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+		}
+		else {
+			transferQueue_ = graphicsQueue_;
+		}
 	}
 
 	void Device::createCommandPool() {
@@ -366,6 +375,18 @@ namespace vc {
 			i++;
 		}
 
+		// prefer a pure copy engine, then an async compute family, both run next to the graphics queue
+		for (uint32_t j = 0; j < queueFamilyCount; j++) {
+			const VkQueueFlags flags = queueFamilies[j].queueFlags;
+			if (queueFamilies[j].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+				continue;
+			}
+			if (!indices.transferFamilyHasValue || !(flags & VK_QUEUE_COMPUTE_BIT)) {
+				indices.transferFamily = j;
+				indices.transferFamilyHasValue = true;
+			}
+		}
+
 		return indices;
 	}
 
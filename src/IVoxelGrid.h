@@ -0,0 +1,9 @@
+#pragma once
+#include <glm/vec3.hpp>
+
+class IVoxelGrid {
+public:
+	virtual float getVoxelSize() const = 0;
+	//voxel coordinates are world position / getVoxelSize(), true when any voxel in the inclusive box blocks movement
+	virtual bool anySolid(glm::ivec3 min, glm::ivec3 max) = 0;
+};
@@ -0,0 +1,114 @@
+#include "InstanceAllocator.h"
+
+#include <algorithm>
+
+namespace vc {
+	std::optional<InstanceAllocator::Range> InstanceAllocator::allocate(uint32_t count, uint64_t owner) {
+		if (count == 0) return Range{};
+
+		Range range{ .count = count };
+		auto hole = holes.begin();
+		while (hole != holes.end() && hole->second < count) hole++;
+		if (hole != holes.end()) {
+			range.first = hole->first;
+			if (hole->second > count) holes[hole->first + count] = hole->second - count;
+			holes.erase(hole);
+		}
+		else if (capacity - end >= count) {
+			range.first = end;
+			end += count;
+		}
+		else return std::nullopt;
+
+		ranges[range.first] = { count, owner };
+		used += count;
+		return range;
+	}
+
+	void InstanceAllocator::free(Range range) {
+		if (range.count == 0 || ranges.erase(range.first) == 0) return;
+		used -= range.count;
+		addHole(range.first, range.count);
+	}
+
+	bool InstanceAllocator::resize(Range& range, uint32_t count) {
+		auto it = ranges.find(range.first);
+		if (range.count == 0 || it == ranges.end()) return false;
+		if (count == 0) {
+			free(range);
+			range = Range{};
+			return true;
+		}
+		if (count < range.count) {
+			used -= range.count - count;
+			addHole(range.first + count, range.count - count);
+		}
+		else if (count > range.count) {
+			const uint32_t extra = count - range.count;
+			const uint32_t behind = range.first + range.count;
+			auto hole = holes.find(behind);
+			if (hole != holes.end() && hole->second >= extra) {
+				if (hole->second > extra) holes[behind + extra] = hole->second - extra;
+				holes.erase(hole);
+			}
+			else if (behind == end && capacity - end >= extra) end += extra;
+			else return false;
+			used += extra;
+		}
+		it->second.first = count;
+		range.count = count;
+		return true;
+	}
+
+	void InstanceAllocator::addHole(uint32_t first, uint32_t count) {
+		auto next = holes.lower_bound(first);
+		if (next != holes.end() && next->first == first + count) {
+			count += next->second;
+			next = holes.erase(next);
+		}
+		if (next != holes.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == first) {
+				first = prev->first;
+				count += prev->second;
+				holes.erase(prev);
+			}
+		}
+		// a hole at the end just lowers the high water mark
+		if (first + count == end) end = first;
+		else holes[first] = count;
+	}
+
+	void InstanceAllocator::clear() {
+		holes.clear();
+		ranges.clear();
+		end = 0;
+		used = 0;
+	}
+
+	std::vector<InstanceAllocator::Move> InstanceAllocator::compact(uint32_t budget) {
+		std::vector<Move> moves{};
+		while (!ranges.empty() && !holes.empty()) {
+			auto last = std::prev(ranges.end());
+			auto [count, owner] = last->second;
+			// a range larger than the whole budget still moves when it comes first, or it would block compaction for good
+			if (count > budget && !moves.empty()) break;
+
+			auto hole = holes.begin();
+			while (hole != holes.end() && hole->second < count) hole++;
+			if (hole == holes.end() || hole->first > last->first) break;
+
+			Range from{ last->first, count };
+			Move move{ .owner = owner, .from = from, .to = hole->first };
+			if (hole->second > count) holes[hole->first + count] = hole->second - count;
+			holes.erase(hole);
+			ranges.erase(last);
+			ranges[move.to] = { count, owner };
+			addHole(from.first, from.count);
+
+			moves.push_back(move);
+			budget -= std::min(budget, count);
+		}
+		return moves;
+	}
+}
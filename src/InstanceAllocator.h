@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+namespace vc {
+	/* Hands out contiguous ranges of instance slots. Everything below the high water mark is drawn,
+	 * so freed ranges become holes that later allocations reuse and compaction closes by moving the
+	 * last ranges down into them a few at a time.
+	 */
+	class InstanceAllocator {
+	public:
+		struct Range {
+			uint32_t first = 0;
+			uint32_t count = 0;
+		};
+		struct Move {
+			uint64_t owner;
+			Range from;
+			uint32_t to;
+		};
+
+		InstanceAllocator(uint32_t capacity) :capacity{ capacity } {}
+
+		// owner is only handed back in the Moves of compact, so the caller can find what moved
+		std::optional<Range> allocate(uint32_t count, uint64_t owner);
+		void free(Range range);
+		// grows or shrinks the range without moving it, false when the slots behind it are taken
+		bool resize(Range& range, uint32_t count);
+		void clear();
+		// moves at most budget slots worth of ranges from the end into holes, or a single range that is larger
+		std::vector<Move> compact(uint32_t budget);
+
+		uint32_t getEnd() const { return end; }
+		uint32_t getUsed() const { return used; }
+		uint32_t getHoles() const { return end - used; }
+	private:
+		uint32_t capacity;
+		uint32_t end = 0;
+		uint32_t used = 0;
+		std::map<uint32_t, uint32_t> holes{};//first -> count, never adjacent and always below end
+		std::map<uint32_t, std::pair<uint32_t, uint64_t>> ranges{};//first -> count, owner
+
+		void addHole(uint32_t first, uint32_t count);
+	};
+}
@@ -0,0 +1,198 @@
+#include "NoiseService.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static constexpr int MASK = PerlinKernel::TABLESIZE - 1;
+
+// splitmix64, used instead of <random> so a seed gives the same world with every standard library
+static uint64_t nextRandom(uint64_t& state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+NoiseService::NoiseService(uint32_t seed) :seed{ seed } {
+	uint64_t state = seed;
+	for (int i = 0; i < PerlinKernel::TABLESIZE; i++)
+		perm[i] = i;
+	for (int i = PerlinKernel::TABLESIZE - 1; i > 0; i--)
+		std::swap(perm[i], perm[nextRandom(state) % (i + 1)]);
+	for (int i = 0; i < PerlinKernel::TABLESIZE; i++)
+		perm[i + PerlinKernel::TABLESIZE] = perm[i];
+
+	// evenly spaced unit gradients, the permutation takes care of the randomness
+	const double step = 2 * 3.14159265358979323846 / PerlinKernel::TABLESIZE;
+	for (int i = 0; i < PerlinKernel::TABLESIZE; i++) {
+		gradX[i] = static_cast<float>(std::sin(i * step));
+		gradY[i] = static_cast<float>(std::cos(i * step));
+	}
+}
+
+PerlinKernel::Octaves NoiseService::octaves(const Fractal& f) const {
+	PerlinKernel::Octaves res{ .count = std::min(f.octaves, PerlinKernel::MAXOCTAVES), .offset = f.offset };
+	float freq = f.frequency;
+	float amp = f.amplitude;
+	for (int i = 0; i < res.count; i++) {
+		res.octaves[i] = { .frequency = freq, .amplitude = amp };
+		freq *= 2;
+		amp /= 2;
+	}
+	return res;
+}
+
+float NoiseService::fractal(const Fractal& f, float x, float z) const {
+	return PerlinKernel::fractal(tables(), octaves(f), x, z);
+}
+
+NoiseService::Region NoiseService::region(const Fractal& f, float minX, float minZ, float maxX, float maxZ, int columns) const {
+	Region res{};
+	res.octaves = octaves(f);
+
+	// an octave is only cached when its lattice window needs fewer gradients than the columns' corners
+	size_t offsets[PerlinKernel::MAXOCTAVES + 1] = {};
+	for (int i = 0; i < res.octaves.count; i++) {
+		PerlinKernel::Octave& octave = res.octaves.octaves[i];
+		octave.originX = (int)((minX + f.offset) * octave.frequency);
+		octave.originZ = (int)((minZ + f.offset) * octave.frequency);
+		int width = (int)((maxX + f.offset) * octave.frequency) + 2 - octave.originX;
+		int depth = (int)((maxZ + f.offset) * octave.frequency) + 2 - octave.originZ;
+		size_t cells = static_cast<size_t>(width) * depth;
+		octave.stride = (cells <= static_cast<size_t>(4 * columns)) ? depth : 0;
+		offsets[i + 1] = offsets[i] + (octave.stride ? cells : 0);
+	}
+
+	res.gridX.resize(offsets[res.octaves.count]);
+	res.gridY.resize(offsets[res.octaves.count]);
+	for (int i = 0; i < res.octaves.count; i++) {
+		PerlinKernel::Octave& octave = res.octaves.octaves[i];
+		if (octave.stride == 0) continue;
+		octave.gridX = res.gridX.data() + offsets[i];
+		octave.gridY = res.gridY.data() + offsets[i];
+		int width = static_cast<int>((offsets[i + 1] - offsets[i]) / octave.stride);
+		for (int x = 0; x < width; x++) {
+			int hx = perm[(octave.originX + x) & MASK];
+			for (int z = 0; z < octave.stride; z++) {
+				int h = perm[hx + ((octave.originZ + z) & MASK)];
+				res.gridX[offsets[i] + x * octave.stride + z] = gradX[h];
+				res.gridY[offsets[i] + x * octave.stride + z] = gradY[h];
+			}
+		}
+	}
+	return res;
+}
+
+void NoiseService::fractal8(const Region& r, const float* x, const float* z, float* out) const {
+	PerlinKernel::fractal8(tables(), r.octaves, x, z, out);
+}
+
+void NoiseService::fractal8(PerlinKernel::Isa isa, const Region& r, const float* x, const float* z, float* out) const {
+	PerlinKernel::fractal8(isa, tables(), r.octaves, x, z, out);
+}
+
+// dot product with one of the 12 cube edge directions picked by the hash
+static float gradient3(int hash, float x, float y, float z) {
+	switch (hash % 12) {
+	case 0: return x + y;
+	case 1: return -x + y;
+	case 2: return x - y;
+	case 3: return -x - y;
+	case 4: return x + z;
+	case 5: return -x + z;
+	case 6: return x - z;
+	case 7: return -x - z;
+	case 8: return y + z;
+	case 9: return -y + z;
+	case 10: return y - z;
+	default: return -y - z;
+	}
+}
+
+static float fade(float t) {
+	return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+static float lerp(float a, float b, float w) {
+	return a + w * (b - a);
+}
+
+float NoiseService::perlin3(float x, float y, float z) const {
+	float fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+	int ix = static_cast<int>(fx) & MASK, iy = static_cast<int>(fy) & MASK, iz = static_cast<int>(fz) & MASK;
+	x -= fx;
+	y -= fy;
+	z -= fz;
+	float u = fade(x), v = fade(y), w = fade(z);
+
+	// the doubled permutation table keeps every index below 2 * TABLESIZE
+	int a = perm[ix] + iy, aa = perm[a] + iz, ab = perm[a + 1] + iz;
+	int b = perm[ix + 1] + iy, ba = perm[b] + iz, bb = perm[b + 1] + iz;
+	return lerp(
+		lerp(
+			lerp(gradient3(perm[aa], x, y, z), gradient3(perm[ba], x - 1, y, z), u),
+			lerp(gradient3(perm[ab], x, y - 1, z), gradient3(perm[bb], x - 1, y - 1, z), u), v),
+		lerp(
+			lerp(gradient3(perm[aa + 1], x, y, z - 1), gradient3(perm[ba + 1], x - 1, y, z - 1), u),
+			lerp(gradient3(perm[ab + 1], x, y - 1, z - 1), gradient3(perm[bb + 1], x - 1, y - 1, z - 1), u), v),
+		w);
+}
+
+float NoiseService::fractal3(const Fractal& f, float x, float y, float z) const {
+	PerlinKernel::Octaves o = octaves(f);
+	float val = 0;
+	for (int i = 0; i < o.count; i++) {
+		const PerlinKernel::Octave& octave = o.octaves[i];
+		val += perlin3((x + o.offset) * octave.frequency, (y + o.offset) * octave.frequency, (z + o.offset) * octave.frequency) * octave.amplitude;
+	}
+	return val;
+}
+
+NoiseService::BenchmarkResult NoiseService::benchmark(const Fractal& f, int chunks) const {
+	// chunk shaped batches of 8x8 columns, one voxel (1/16) apart
+	const int side = PerlinKernel::WIDTH;
+	const float spacing = 1.f / 16.f;
+	const int columns = chunks * side * side;
+	std::vector<float> xs(columns), zs(columns), reference(columns), scalar(columns), simd(columns);
+	uint64_t state = seed;
+	for (int c = 0; c < chunks; c++) {
+		float ox = static_cast<float>(static_cast<int>(nextRandom(state) % 8192) - 4096) * side * spacing;
+		float oz = static_cast<float>(static_cast<int>(nextRandom(state) % 8192) - 4096) * side * spacing;
+		for (int x = 0; x < side; x++) {
+			for (int z = 0; z < side; z++) {
+				xs[(c * side + x) * side + z] = ox + x * spacing;
+				zs[(c * side + x) * side + z] = oz + z * spacing;
+			}
+		}
+	}
+
+	BenchmarkResult res{ .isa = PerlinKernel::getIsa() };
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < columns; i++)
+		reference[i] = fractal(f, xs[i], zs[i]);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	res.referenceColumnsPerSecond = columns / elapsed.count();
+
+	auto run = [&](PerlinKernel::Isa isa, std::vector<float>& out) {
+		auto start = std::chrono::steady_clock::now();
+		for (int c = 0; c < chunks; c++) {
+			int first = c * side * side;
+			int last = first + side * side - 1;
+			Region r = region(f, xs[first], zs[first], xs[last], zs[last], side * side);
+			for (int i = first; i <= last; i += PerlinKernel::WIDTH)
+				fractal8(isa, r, &xs[i], &zs[i], &out[i]);
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return columns / elapsed.count();
+	};
+	res.scalarColumnsPerSecond = run(PerlinKernel::SCALAR, scalar);
+	res.simdColumnsPerSecond = run(res.isa, simd);
+
+	res.maxError = 0;
+	for (int i = 0; i < columns; i++) {
+		res.maxError = std::fmax(res.maxError, std::fabs(simd[i] - reference[i]));
+		res.maxError = std::fmax(res.maxError, std::fabs(scalar[i] - reference[i]));
+	}
+	return res;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "PerlinKernel.h"
+
+/* Seeded gradient noise. The permutation and gradient tables are built once from the world seed,
+ * regions cache the lattice gradients of every octave a chunk touches so neighbouring columns reuse them.
+ */
+class NoiseService {
+public:
+	struct Fractal {
+		int octaves = 12;
+		float amplitude = 3.f;
+		float frequency = 1.f / 16.f;
+		float offset = 1000000.f;
+	};
+
+	class Region {
+		friend class NoiseService;
+		PerlinKernel::Octaves octaves{};
+		std::vector<float> gridX{};
+		std::vector<float> gridY{};
+	public:
+		Region() = default;
+		Region(const Region&) = delete;
+		Region& operator=(const Region&) = delete;
+		Region(Region&&) = default;
+		Region& operator=(Region&&) = default;
+	};
+
+	struct BenchmarkResult {
+		PerlinKernel::Isa isa;
+		double referenceColumnsPerSecond;
+		double scalarColumnsPerSecond;
+		double simdColumnsPerSecond;
+		float maxError;
+	};
+
+	NoiseService(uint32_t seed);
+	NoiseService(const NoiseService&) = delete;
+	NoiseService& operator=(const NoiseService&) = delete;
+
+	uint32_t getSeed() const { return seed; }
+
+	// Reference evaluation of a single column, straight from the tables
+	float fractal(const Fractal& f, float x, float z) const;
+	// [minX, maxX] x [minZ, maxZ] must contain every column later passed to fractal8 with this region
+	Region region(const Fractal& f, float minX, float minZ, float maxX, float maxZ, int columns) const;
+	void fractal8(const Region& r, const float* x, const float* z, float* out) const;
+	void fractal8(PerlinKernel::Isa isa, const Region& r, const float* x, const float* z, float* out) const;
+	// 3D noise for density volumes, scalar only since it is meant to be sampled on a coarse lattice
+	float fractal3(const Fractal& f, float x, float y, float z) const;
+
+	BenchmarkResult benchmark(const Fractal& f, int chunks = 1024) const;
+private:
+	uint32_t seed;
+	std::array<int32_t, 2 * PerlinKernel::TABLESIZE> perm{};
+	std::array<float, PerlinKernel::TABLESIZE> gradX{};
+	std::array<float, PerlinKernel::TABLESIZE> gradY{};
+
+	PerlinKernel::Tables tables() const { return { perm.data(), gradX.data(), gradY.data() }; }
+	PerlinKernel::Octaves octaves(const Fractal& f) const;
+	float perlin3(float x, float y, float z) const;
+};
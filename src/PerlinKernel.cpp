@@ -0,0 +1,130 @@
+#include "PerlinKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PERLIN_KERNEL_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+static constexpr int MASK = PerlinKernel::TABLESIZE - 1;
+
+static void gradient(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, int ix, int iy, float& gx, float& gy) {
+	if (o.gridX != nullptr) {
+		int i = (ix - o.originX) * o.stride + (iy - o.originZ);
+		gx = o.gridX[i];
+		gy = o.gridY[i];
+	}
+	else {
+		int h = t.perm[t.perm[ix & MASK] + (iy & MASK)];
+		gx = t.gradX[h];
+		gy = t.gradY[h];
+	}
+}
+
+// Computes the dot product of the distance and gradient vectors.
+static float dotGridGradient(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, int ix, int iy, float x, float y) {
+	// Get gradient from integer coordinates
+	float gx, gy;
+	gradient(t, o, ix, iy, gx, gy);
+
+	// Compute the distance vector
+	float dx = x - (float)ix;
+	float dy = y - (float)iy;
+
+	// Compute the dot-product
+	return (dx * gx + dy * gy);
+}
+
+static float interpolate(float a0, float a1, float w) {
+	return (a1 - a0) * (3.0 - w * 2.0) * w * w + a0;
+}
+
+// Sample Perlin noise at coordinates x, y
+static float perlin(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, float x, float y) {
+	// Determine grid cell corner coordinates
+	int x0 = (int)x;
+	int y0 = (int)y;
+	int x1 = x0 + 1;
+	int y1 = y0 + 1;
+
+	// Compute Interpolation weights
+	float sx = x - (float)x0;
+	float sy = y - (float)y0;
+
+	// Compute and interpolate top two corners
+	float n0 = dotGridGradient(t, o, x0, y0, x, y);
+	float n1 = dotGridGradient(t, o, x1, y0, x, y);
+	float ix0 = interpolate(n0, n1, sx);
+
+	// Compute and interpolate bottom two corners
+	n0 = dotGridGradient(t, o, x0, y1, x, y);
+	n1 = dotGridGradient(t, o, x1, y1, x, y);
+	float ix1 = interpolate(n0, n1, sx);
+
+	// Final step: interpolate between the two previously interpolated values, now in y
+	return interpolate(ix0, ix1, sy);
+}
+
+float PerlinKernel::fractal(const Tables& t, const Octaves& o, float x, float z) {
+	float val = 0;
+	for (int i = 0; i < o.count; i++) {
+		const Octave& octave = o.octaves[i];
+		val += perlin(t, octave, (x + o.offset) * octave.frequency, (z + o.offset) * octave.frequency) * octave.amplitude;
+	}
+	return val;
+}
+
+void PerlinKernel::fractal8(const Tables& t, const Octaves& o, const float* x, const float* z, float* out) {
+	static const Isa isa = getIsa();
+	fractal8(isa, t, o, x, z, out);
+}
+
+void PerlinKernel::fractal8(Isa isa, const Tables& t, const Octaves& o, const float* x, const float* z, float* out) {
+	switch (isa) {
+#ifdef PERLIN_KERNEL_X86
+	case AVX2:
+		fractal8AVX2(t, o, x, z, out);
+		break;
+	case SSE4:
+		fractal8SSE4(t, o, x, z, out);
+		break;
+#endif
+	default:
+		for (int i = 0; i < WIDTH; i++)
+			out[i] = fractal(t, o, x[i], z[i]);
+	}
+}
+
+PerlinKernel::Isa PerlinKernel::getIsa() {
+#ifdef PERLIN_KERNEL_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool sse41 = (info[2] & (1 << 19)) != 0;
+	bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osAvx) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse41 = __builtin_cpu_supports("sse4.1");
+	bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+	if (avx2) return AVX2;
+	if (sse41) return SSE4;
+#endif
+	return SCALAR;
+}
+
+const char* PerlinKernel::isaName(Isa isa) {
+	switch (isa) {
+	case AVX2: return "AVX2";
+	case SSE4: return "SSE4.1";
+	default: return "scalar";
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+
+/* Fractal Perlin noise used for terrain columns.
+ * The scalar path is the reference implementation, the SSE4.1/AVX2 paths evaluate
+ * WIDTH columns per call and are selected at runtime from the cpu features.
+ * Gradients come from the seeded tables of a NoiseService, either straight from the
+ * permutation table or from a per-octave window of lattice gradients cached for a chunk.
+ */
+class PerlinKernel {
+public:
+	enum Isa {
+		SCALAR = 0,
+		SSE4,
+		AVX2,
+		NUM_ISA
+	};
+
+	static constexpr int TABLESIZE = 256;
+	static constexpr int MAXOCTAVES = 16;
+
+	struct Tables {
+		const int32_t* perm;  // 2 * TABLESIZE entries, doubled so perm[perm[x] + y] never wraps
+		const float* gradX;   // TABLESIZE unit gradients
+		const float* gradY;
+	};
+
+	struct Octave {
+		float frequency;
+		float amplitude;
+		// cached lattice window, gridX == nullptr means gradients are looked up in the tables
+		const float* gridX = nullptr;
+		const float* gridY = nullptr;
+		int originX = 0;
+		int originZ = 0;
+		int stride = 0;
+	};
+
+	struct Octaves {
+		Octave octaves[MAXOCTAVES];
+		int count;
+		float offset;
+	};
+
+	static constexpr int WIDTH = 8;
+	// Max absolute difference between the SIMD and scalar heights (measured ~1e-6). The SIMD paths
+	// interpolate in float where the scalar path uses double.
+	static constexpr float TOLERANCE = 1e-5f;
+
+	static float fractal(const Tables& t, const Octaves& o, float x, float z);
+	static void fractal8(const Tables& t, const Octaves& o, const float* x, const float* z, float* out);
+	static void fractal8(Isa isa, const Tables& t, const Octaves& o, const float* x, const float* z, float* out);
+
+	static Isa getIsa();
+	static const char* isaName(Isa isa);
+};
+
+// Implemented in PerlinKernelSSE4.cpp and PerlinKernelAVX2.cpp, only valid when getIsa() reports support
+void fractal8SSE4(const PerlinKernel::Tables& t, const PerlinKernel::Octaves& o, const float* x, const float* z, float* out);
+void fractal8AVX2(const PerlinKernel::Tables& t, const PerlinKernel::Octaves& o, const float* x, const float* z, float* out);
@@ -0,0 +1,72 @@
+#include "PerlinKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#endif
+#include <immintrin.h>
+
+// 8 lanes of gradient lookups, from the cached lattice window or through the permutation table
+static inline void gradient(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, __m256i ix, __m256i iy, __m256& gx, __m256& gy) {
+	if (o.gridX != nullptr) {
+		__m256i i = _mm256_add_epi32(
+			_mm256_mullo_epi32(_mm256_sub_epi32(ix, _mm256_set1_epi32(o.originX)), _mm256_set1_epi32(o.stride)),
+			_mm256_sub_epi32(iy, _mm256_set1_epi32(o.originZ)));
+		gx = _mm256_i32gather_ps(o.gridX, i, 4);
+		gy = _mm256_i32gather_ps(o.gridY, i, 4);
+	}
+	else {
+		const __m256i mask = _mm256_set1_epi32(PerlinKernel::TABLESIZE - 1);
+		__m256i h = _mm256_i32gather_epi32((const int*)t.perm, _mm256_and_si256(ix, mask), 4);
+		h = _mm256_i32gather_epi32((const int*)t.perm, _mm256_add_epi32(h, _mm256_and_si256(iy, mask)), 4);
+		gx = _mm256_i32gather_ps(t.gradX, h, 4);
+		gy = _mm256_i32gather_ps(t.gradY, h, 4);
+	}
+}
+
+static inline __m256 dotGridGradient(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, __m256i ix, __m256i iy, __m256 x, __m256 y) {
+	__m256 gx, gy;
+	gradient(t, o, ix, iy, gx, gy);
+	__m256 dx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(ix));
+	__m256 dy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(iy));
+	return _mm256_add_ps(_mm256_mul_ps(dx, gx), _mm256_mul_ps(dy, gy));
+}
+
+static inline __m256 interpolate(__m256 a0, __m256 a1, __m256 w) {
+	__m256 smooth = _mm256_sub_ps(_mm256_set1_ps(3.f), _mm256_add_ps(w, w));
+	return _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(a1, a0), smooth), w), w), a0);
+}
+
+static inline __m256 perlin(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, __m256 x, __m256 y) {
+	__m256i x0 = _mm256_cvttps_epi32(x);
+	__m256i y0 = _mm256_cvttps_epi32(y);
+	__m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(1));
+	__m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(1));
+
+	__m256 sx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+	__m256 sy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+
+	__m256 ix0 = interpolate(dotGridGradient(t, o, x0, y0, x, y), dotGridGradient(t, o, x1, y0, x, y), sx);
+	__m256 ix1 = interpolate(dotGridGradient(t, o, x0, y1, x, y), dotGridGradient(t, o, x1, y1, x, y), sx);
+	return interpolate(ix0, ix1, sy);
+}
+
+void fractal8AVX2(const PerlinKernel::Tables& t, const PerlinKernel::Octaves& o, const float* x, const float* z, float* out) {
+	__m256 px = _mm256_add_ps(_mm256_loadu_ps(x), _mm256_set1_ps(o.offset));
+	__m256 pz = _mm256_add_ps(_mm256_loadu_ps(z), _mm256_set1_ps(o.offset));
+	__m256 val = _mm256_setzero_ps();
+	for (int i = 0; i < o.count; i++) {
+		const PerlinKernel::Octave& octave = o.octaves[i];
+		__m256 freq = _mm256_set1_ps(octave.frequency);
+		__m256 n = perlin(t, octave, _mm256_mul_ps(px, freq), _mm256_mul_ps(pz, freq));
+		val = _mm256_add_ps(val, _mm256_mul_ps(n, _mm256_set1_ps(octave.amplitude)));
+	}
+	_mm256_storeu_ps(out, val);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+#endif
@@ -0,0 +1,91 @@
+#include "PerlinKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("sse4.1")
+#endif
+#include <immintrin.h>
+
+// SSE has no gather, lanes are loaded one by one
+static inline __m128 gather(const float* base, __m128i index) {
+	return _mm_setr_ps(
+		base[_mm_extract_epi32(index, 0)],
+		base[_mm_extract_epi32(index, 1)],
+		base[_mm_extract_epi32(index, 2)],
+		base[_mm_extract_epi32(index, 3)]);
+}
+
+static inline __m128i gather(const int32_t* base, __m128i index) {
+	return _mm_setr_epi32(
+		base[_mm_extract_epi32(index, 0)],
+		base[_mm_extract_epi32(index, 1)],
+		base[_mm_extract_epi32(index, 2)],
+		base[_mm_extract_epi32(index, 3)]);
+}
+
+// 4 lanes of gradient lookups, from the cached lattice window or through the permutation table
+static inline void gradient(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, __m128i ix, __m128i iy, __m128& gx, __m128& gy) {
+	if (o.gridX != nullptr) {
+		__m128i i = _mm_add_epi32(
+			_mm_mullo_epi32(_mm_sub_epi32(ix, _mm_set1_epi32(o.originX)), _mm_set1_epi32(o.stride)),
+			_mm_sub_epi32(iy, _mm_set1_epi32(o.originZ)));
+		gx = gather(o.gridX, i);
+		gy = gather(o.gridY, i);
+	}
+	else {
+		const __m128i mask = _mm_set1_epi32(PerlinKernel::TABLESIZE - 1);
+		__m128i h = gather(t.perm, _mm_and_si128(ix, mask));
+		h = gather(t.perm, _mm_add_epi32(h, _mm_and_si128(iy, mask)));
+		gx = gather(t.gradX, h);
+		gy = gather(t.gradY, h);
+	}
+}
+
+static inline __m128 dotGridGradient(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, __m128i ix, __m128i iy, __m128 x, __m128 y) {
+	__m128 gx, gy;
+	gradient(t, o, ix, iy, gx, gy);
+	__m128 dx = _mm_sub_ps(x, _mm_cvtepi32_ps(ix));
+	__m128 dy = _mm_sub_ps(y, _mm_cvtepi32_ps(iy));
+	return _mm_add_ps(_mm_mul_ps(dx, gx), _mm_mul_ps(dy, gy));
+}
+
+static inline __m128 interpolate(__m128 a0, __m128 a1, __m128 w) {
+	__m128 smooth = _mm_sub_ps(_mm_set1_ps(3.f), _mm_add_ps(w, w));
+	return _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(a1, a0), smooth), w), w), a0);
+}
+
+static inline __m128 perlin(const PerlinKernel::Tables& t, const PerlinKernel::Octave& o, __m128 x, __m128 y) {
+	__m128i x0 = _mm_cvttps_epi32(x);
+	__m128i y0 = _mm_cvttps_epi32(y);
+	__m128i x1 = _mm_add_epi32(x0, _mm_set1_epi32(1));
+	__m128i y1 = _mm_add_epi32(y0, _mm_set1_epi32(1));
+
+	__m128 sx = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+	__m128 sy = _mm_sub_ps(y, _mm_cvtepi32_ps(y0));
+
+	__m128 ix0 = interpolate(dotGridGradient(t, o, x0, y0, x, y), dotGridGradient(t, o, x1, y0, x, y), sx);
+	__m128 ix1 = interpolate(dotGridGradient(t, o, x0, y1, x, y), dotGridGradient(t, o, x1, y1, x, y), sx);
+	return interpolate(ix0, ix1, sy);
+}
+
+void fractal8SSE4(const PerlinKernel::Tables& t, const PerlinKernel::Octaves& o, const float* x, const float* z, float* out) {
+	for (int half = 0; half < PerlinKernel::WIDTH; half += 4) {
+		__m128 px = _mm_add_ps(_mm_loadu_ps(x + half), _mm_set1_ps(o.offset));
+		__m128 pz = _mm_add_ps(_mm_loadu_ps(z + half), _mm_set1_ps(o.offset));
+		__m128 val = _mm_setzero_ps();
+		for (int i = 0; i < o.count; i++) {
+			const PerlinKernel::Octave& octave = o.octaves[i];
+			__m128 freq = _mm_set1_ps(octave.frequency);
+			__m128 n = perlin(t, octave, _mm_mul_ps(px, freq), _mm_mul_ps(pz, freq));
+			val = _mm_add_ps(val, _mm_mul_ps(n, _mm_set1_ps(octave.amplitude)));
+		}
+		_mm_storeu_ps(out + half, val);
+	}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+#endif
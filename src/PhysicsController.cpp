@@ -0,0 +1,100 @@
+#include "PhysicsController.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+namespace ic {
+	size_t PhysicsController::add(const Body& body) {
+		if (freeIds.empty()) {
+			bodies.emplace_back(body);
+			return bodies.size() - 1;
+		}
+		size_t id = freeIds.back();
+		freeIds.pop_back();
+		bodies[id].emplace(body);
+		return id;
+	}
+
+	void PhysicsController::remove(size_t id) {
+		bodies[id].reset();
+		freeIds.push_back(id);
+	}
+
+	void PhysicsController::step(float delta) {
+		auto start = std::chrono::steady_clock::now();
+		auto elapsed = [&start]() { return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+		stepped = 0;
+		deferred = 0;
+		const size_t count = bodies.size();
+		size_t resume = next;
+		bool over = false;
+		for (size_t n = 0; n < count; n++) {
+			const size_t id = (next + n) % count;
+			if (!bodies[id]) continue;
+			Body& body = *bodies[id];
+			body.pending = std::min(body.pending + delta, maxPending);
+			if (!over && elapsed() > budget) {
+				over = true;
+				resume = id;
+			}
+			if (over) {
+				deferred++;
+				continue;
+			}
+			while (body.pending > 0) {
+				float dt = std::min(body.pending, maxStep);
+				move(body, dt);
+				body.pending -= dt;
+			}
+			stepped++;
+		}
+		next = resume;
+		stepTime = elapsed();
+	}
+
+	void PhysicsController::move(Body& body, float dt) {
+		if (body.gravity) body.velocity += gravity * dt;
+		body.grounded = false;
+		// one axis at a time, vertical first so a body walking on the ground does not catch on the voxels under it
+		for (int axis : { 1, 0, 2 }) {
+			float distance = body.velocity[axis] * dt;
+			if (distance == 0) continue;
+			float moved = sweep(body, axis, distance);
+			body.position[axis] += moved;
+			if (moved != distance) {
+				if (axis == 1 && distance > 0) body.grounded = true;
+				body.velocity[axis] = 0;
+			}
+		}
+	}
+
+	float PhysicsController::sweep(const Body& body, int axis, float distance) {
+		const float size = grid.getVoxelSize();
+		const float eps = 1e-4f;//voxels, a face resting on a boundary does not reach into the next cell
+		const glm::vec3 lo = (body.position - body.halfExtents) / size;
+		const glm::vec3 hi = (body.position + body.halfExtents) / size;
+		const float move = distance / size;
+		// only the layers of cells the leading face enters are candidates, the box already overlaps the others
+		glm::ivec3 min{ glm::floor(lo + eps) }, max{ glm::ceil(hi - eps) - 1.f };
+		if (move > 0) {
+			const int first = static_cast<int>(std::ceil(hi[axis] - eps));
+			const int last = static_cast<int>(std::ceil(hi[axis] + move - eps)) - 1;
+			for (int layer = first; layer <= last; layer++) {
+				min[axis] = max[axis] = layer;
+				if (grid.anySolid(min, max)) return std::max(layer - hi[axis], 0.f) * size;
+			}
+		}
+		else {
+			const int first = static_cast<int>(std::floor(lo[axis] + eps)) - 1;
+			const int last = static_cast<int>(std::floor(lo[axis] + move + eps));
+			for (int layer = first; layer >= last; layer--) {
+				min[axis] = max[axis] = layer;
+				if (grid.anySolid(min, max)) return std::min(layer + 1 - lo[axis], 0.f) * size;
+			}
+		}
+		return distance;
+	}
+}
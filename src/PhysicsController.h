@@ -0,0 +1,57 @@
+#pragma once
+#include <optional>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "IVoxelGrid.h"
+#include "Updatable.h"
+
+namespace ic {
+	/* Moves axis aligned boxes through a voxel grid under gravity. Every step sweeps a box along y, x then z
+	 * and stops it in front of the first layer of voxels it would enter, so nothing tunnels however fast it goes.
+	 * Bodies left over once the budget is spent keep their time and are stepped first at the next update.
+	 */
+	class PhysicsController : public Updatable {
+	public:
+		struct Body {
+			glm::vec3 position{};//centre of the box, world units
+			glm::vec3 halfExtents{ 0.3f, 0.9f, 0.3f };
+			glm::vec3 velocity{};
+			bool gravity = true;
+			bool grounded = false;//stood on a voxel at the last step, y points down
+			float pending = 0;//seconds not simulated yet
+		};
+	private:
+		IVoxelGrid& grid;
+		std::vector<std::optional<Body>> bodies{};
+		std::vector<size_t> freeIds{};
+		size_t next = 0;//first body stepped at the next update
+		float budget;//ms per update
+		glm::vec3 gravity{ 0.f, 20.f, 0.f };
+		float maxStep = 1.f / 30.f;//longer pending times are split so fast bodies stay stable
+		float maxPending = 0.25f;//time a starved body can catch up on at once
+		int stepped = 0, deferred = 0;
+		float stepTime = 0;//ms
+
+		void move(Body& body, float dt);
+		//distance the box can travel along axis before touching a solid voxel, distance itself when nothing is in the way
+		float sweep(const Body& body, int axis, float distance);
+	protected:
+		void update(float delta) override { step(delta); }
+	public:
+		PhysicsController(IVoxelGrid& grid, float budget) :grid{ grid }, budget{ budget } { queueUpdate(); }
+
+		size_t add(const Body& body);
+		void remove(size_t id);
+		Body& get(size_t id) { return *bodies[id]; }
+		size_t size() const { return bodies.size() - freeIds.size(); }
+
+		//advances every body by delta seconds until budget is spent
+		void step(float delta);
+		void setGravity(glm::vec3 g) { gravity = g; }
+		int getStepped() const { return stepped; }
+		int getDeferred() const { return deferred; }
+		float getStepTime() const { return stepTime; }
+	};
+}
@@ -0,0 +1,228 @@
+#include "RegionStore.h"
+
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RegionStore::MappedFile::MappedFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+	HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return;
+	file = handle;
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) return;
+	mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) return;
+	view = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (view != nullptr) length = static_cast<size_t>(size.QuadPart);
+#else
+	file = open(path.c_str(), O_RDONLY);
+	if (file < 0) return;
+	struct stat info {};
+	if (fstat(file, &info) != 0 || info.st_size == 0) return;
+	void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+	if (mapped == MAP_FAILED) return;
+	view = static_cast<const uint8_t*>(mapped);
+	length = static_cast<size_t>(info.st_size);
+#endif
+}
+
+RegionStore::MappedFile::~MappedFile() {
+#ifdef _WIN32
+	if (view != nullptr) UnmapViewOfFile(view);
+	if (mapping != nullptr) CloseHandle(mapping);
+	if (file != nullptr) CloseHandle(file);
+#else
+	if (view != nullptr) munmap(const_cast<uint8_t*>(view), length);
+	if (file >= 0) close(file);
+#endif
+}
+
+RegionStore::RegionStore(std::filesystem::path directory) :directory{ std::move(directory) } {
+	std::error_code error;
+	std::filesystem::create_directories(this->directory, error);
+}
+
+RegionStore::~RegionStore() {
+	writer.wait();
+}
+
+std::filesystem::path RegionStore::regionPath(int rx, int rz) const {
+	return directory / ("r." + std::to_string(rx) + "." + std::to_string(rz) + ".region");
+}
+
+int RegionStore::regionOf(int c) {
+	return c >= 0 ? c / REGIONSIZE : (c + 1) / REGIONSIZE - 1;
+}
+
+size_t RegionStore::entryOffset(int cx, int cz) {
+	const int index = (cx - regionOf(cx) * REGIONSIZE) * REGIONSIZE + (cz - regionOf(cz) * REGIONSIZE);
+	return sizeof(MAGIC) + sizeof(VERSION) + index * sizeof(Entry);
+}
+
+bool RegionStore::read(int cx, int cz, std::vector<uint8_t>& out) {
+	std::lock_guard<std::mutex> lock{ mutex };
+	if (auto* data = queued.get(cx, cz)) {
+		out = *data;
+		return true;
+	}
+	if (writing && writing->cx == cx && writing->cz == cz) {
+		out = writing->data;
+		return true;
+	}
+
+	const int rx = regionOf(cx), rz = regionOf(cz);
+	auto* region = regions.get(rx, rz);
+	if (region == nullptr)
+		region = regions.get(regions.insert(rx, rz, std::make_unique<MappedFile>(regionPath(rx, rz))).first);
+
+	const MappedFile& file = **region;
+	if (file.size() < HEADERSIZE || std::memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0) return false;
+	uint32_t version;
+	std::memcpy(&version, file.data() + sizeof(MAGIC), sizeof(version));
+	if (version != VERSION) return false;
+
+	Entry entry;
+	std::memcpy(&entry, file.data() + entryOffset(cx, cz), sizeof(entry));
+	if (entry.size == 0 || entry.offset < HEADERSIZE || static_cast<size_t>(entry.offset) + entry.size > file.size()) return false;
+	out.assign(file.data() + entry.offset, file.data() + entry.offset + entry.size);
+	return true;
+}
+
+void RegionStore::write(int cx, int cz, std::vector<uint8_t> data) {
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (auto* existing = queued.get(cx, cz)) {
+			// the write already queued for this chunk picks up the newer data
+			*existing = std::move(data);
+			return;
+		}
+		queued.insert(cx, cz, std::move(data));
+	}
+	writer.submit([this, cx, cz]() { store(cx, cz); });
+}
+
+// runs on the writer thread, the file is written outside the lock while reads of the chunk go to the record being written
+void RegionStore::store(int cx, int cz) {
+	const int rx = regionOf(cx), rz = regionOf(cz);
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto* data = queued.get(cx, cz);
+		if (data == nullptr) return;
+		writing = Record{ cx, cz, std::move(*data) };
+		queued.erase(cx, cz);
+		regions.erase(rx, rz);//unmapped before the file changes under it
+	}
+
+	const bool written = append(*writing);
+
+	std::lock_guard<std::mutex> lock{ mutex };
+	// a read may have mapped the file again while it grew, the next one maps all of it
+	regions.erase(rx, rz);
+	// on failure the data stays readable from the queue for this session, unless newer data was queued meanwhile
+	if (!written && queued.get(cx, cz) == nullptr)
+		queued.insert(cx, cz, std::move(writing->data));
+	writing.reset();
+}
+
+bool RegionStore::append(const Record& record) {
+	const auto path = regionPath(regionOf(record.cx), regionOf(record.cz));
+	if (!std::filesystem::exists(path)) {
+		std::ofstream create{ path, std::ios::binary };
+		std::vector<char> header(HEADERSIZE, 0);
+		std::memcpy(header.data(), MAGIC, sizeof(MAGIC));
+		std::memcpy(header.data() + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+		create.write(header.data(), header.size());
+	}
+
+	std::fstream file{ path, std::ios::in | std::ios::out | std::ios::binary };
+	std::vector<Entry> table(REGIONSIZE * REGIONSIZE);
+	file.seekg(sizeof(MAGIC) + sizeof(VERSION));
+	file.read(reinterpret_cast<char*>(table.data()), table.size() * sizeof(Entry));
+	file.seekp(0, std::ios::end);
+	const uint64_t end = static_cast<uint64_t>(file.tellp());
+	if (!file) return false;
+
+	// replaced records stay where they are until they take more space than the live ones
+	const size_t index = (entryOffset(record.cx, record.cz) - sizeof(MAGIC) - sizeof(VERSION)) / sizeof(Entry);
+	uint64_t live = record.data.size();
+	for (size_t i = 0; i < table.size(); i++) {
+		if (i != index && table[i].size != 0 && table[i].offset >= HEADERSIZE && table[i].offset + uint64_t{ table[i].size } <= end)
+			live += table[i].size;
+	}
+	const uint64_t stored = end - HEADERSIZE + record.data.size();
+	if (stored > 2 * live || end + record.data.size() > UINT32_MAX)
+		return compact(file, std::move(table), record);
+
+	Entry entry{ static_cast<uint32_t>(end), static_cast<uint32_t>(record.data.size()) };
+	file.write(reinterpret_cast<const char*>(record.data.data()), record.data.size());
+	file.seekp(entryOffset(record.cx, record.cz));
+	file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	file.flush();
+	return static_cast<bool>(file);
+}
+
+bool RegionStore::compact(std::fstream& file, std::vector<Entry> table, const Record& record) {
+	const int rx = regionOf(record.cx), rz = regionOf(record.cz);
+	const auto path = regionPath(rx, rz);
+	auto temporary = path;
+	temporary += ".tmp";
+	const size_t index = (entryOffset(record.cx, record.cz) - sizeof(MAGIC) - sizeof(VERSION)) / sizeof(Entry);
+	file.seekg(0, std::ios::end);
+	const uint64_t end = static_cast<uint64_t>(file.tellg());
+
+	std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+	std::vector<char> buffer(HEADERSIZE, 0);
+	std::memcpy(buffer.data(), MAGIC, sizeof(MAGIC));
+	std::memcpy(buffer.data() + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+	out.write(buffer.data(), buffer.size());
+
+	uint64_t offset = HEADERSIZE;
+	auto place = [&](Entry& entry, const char* data) {
+		if (offset + entry.size > UINT32_MAX) return false;
+		out.write(data, entry.size);
+		entry.offset = static_cast<uint32_t>(offset);
+		offset += entry.size;
+		return true;
+	};
+	bool fits = true;
+	for (size_t i = 0; i < table.size() && fits; i++) {
+		Entry& entry = table[i];
+		if (i == index || entry.size == 0 || entry.offset < HEADERSIZE || entry.offset + uint64_t{ entry.size } > end) {
+			entry = Entry{ 0, 0 };
+			continue;
+		}
+		buffer.resize(entry.size);
+		file.seekg(entry.offset);
+		file.read(buffer.data(), entry.size);
+		fits = place(entry, buffer.data());
+	}
+	table[index].size = static_cast<uint32_t>(record.data.size());
+	fits = fits && place(table[index], reinterpret_cast<const char*>(record.data.data()));
+	out.seekp(sizeof(MAGIC) + sizeof(VERSION));
+	out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(Entry));
+	out.flush();
+
+	const bool written = fits && file && out;
+	file.close();
+	out.close();
+	std::error_code error;
+	if (written) {
+		// nothing may have the old file mapped while it is replaced
+		std::lock_guard<std::mutex> lock{ mutex };
+		regions.erase(rx, rz);
+		std::filesystem::rename(temporary, path, error);
+	}
+	if (!written || error) std::filesystem::remove(temporary, error);
+	return written && !error;
+}
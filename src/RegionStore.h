@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "ChunkTable.h"
+#include "ThreadPool.h"
+
+/* Chunk persistence in region files of REGIONSIZE x REGIONSIZE chunks.
+ * A region file starts with an offset table of every chunk in it, records are appended behind it
+ * and the table entry is pointed at the newest one. Once the replaced records outweigh the live ones,
+ * or the 32 bit offsets would overflow, the file is rewritten without them. Reads go through a read-only memory mapping of
+ * the file, writes are queued to a background thread and visible to reads as soon as they are queued.
+ */
+class RegionStore {
+public:
+	static constexpr int REGIONSIZE = 32;
+
+	RegionStore(std::filesystem::path directory);
+	// waits for the queued writes
+	~RegionStore();
+
+	RegionStore(const RegionStore&) = delete;
+	RegionStore& operator=(const RegionStore&) = delete;
+
+	// false when the chunk was never stored, safe to call from any thread
+	bool read(int cx, int cz, std::vector<uint8_t>& out);
+	void write(int cx, int cz, std::vector<uint8_t> data);
+
+	int queuedWrites() { return writer.queueDepth() + writer.inFlight(); }
+private:
+	class MappedFile {
+		const uint8_t* view = nullptr;
+		size_t length = 0;
+#ifdef _WIN32
+		void* file = nullptr;
+		void* mapping = nullptr;
+#else
+		int file = -1;
+#endif
+	public:
+		// an empty mapping when the file does not exist
+		MappedFile(const std::filesystem::path& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const uint8_t* data() const { return view; }
+		size_t size() const { return length; }
+	};
+
+	struct Entry {
+		uint32_t offset;
+		uint32_t size;
+	};
+	static constexpr char MAGIC[4] = { 'V', 'X', 'R', 'G' };
+	static constexpr uint32_t VERSION = 1;
+	static constexpr size_t HEADERSIZE = sizeof(MAGIC) + sizeof(VERSION) + REGIONSIZE * REGIONSIZE * sizeof(Entry);
+
+	struct Record {
+		int cx;
+		int cz;
+		std::vector<uint8_t> data;
+	};
+
+	std::filesystem::path directory;
+	std::mutex mutex{};
+	ChunkTable<std::unique_ptr<MappedFile>> regions{};//keyed by region coordinates
+	ChunkTable<std::vector<uint8_t>> queued{};//written by the background thread, keyed by chunk coordinates
+	std::optional<Record> writing{};//taken out of the queue and being appended to its region file
+	ThreadPool writer{ 1 };
+
+	std::filesystem::path regionPath(int rx, int rz) const;
+	static int regionOf(int c);
+	static size_t entryOffset(int cx, int cz);
+	void store(int cx, int cz);
+	// appends the record and points the chunk's entry at it, false when the file could not be written
+	bool append(const Record& record);
+	// writes the live records of table and the new one into a fresh file that replaces the region file,
+	// false when they do not fit in 32 bit offsets either
+	bool compact(std::fstream& file, std::vector<Entry> table, const Record& record);
+};
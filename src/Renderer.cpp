@@ -83,7 +83,7 @@ namespace vc {
 
 		return commandBuffer;
 	}
-	void Renderer::endFrame() {
+	void Renderer::endFrame(const std::vector<SwapChain::Wait>& waits) {
 		if (frameStatus == IDLE)
 			throw std::logic_error("Cannot call endFrame when frame is not already active/started!");
 
@@ -92,7 +92,7 @@ namespace vc {
 			throw std::runtime_error("Failed to end recording for command buffer");
 		}
 
-		auto result = swapChain->submitCommandBuffers(&commandBuffer, &imageIndex);
+		auto result = swapChain->submitCommandBuffers(&commandBuffer, &imageIndex, waits);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || window.wasResized()) {
 			window.resetResized();
 			initSwapChain();
@@ -104,7 +104,7 @@ namespace vc {
 		frameStatus = IDLE;
 		frameIndex = (frameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
 	};
-	void Renderer::startRenderPass(VkCommandBuffer commandBuffer) {
+	void Renderer::startRenderPass(VkCommandBuffer commandBuffer, bool overlay) {
 		if (frameStatus == IDLE)
 			throw std::logic_error("Cannot start render pass when frame is not already active/started!");
 		if(commandBuffer != getActiveCommandBuffer())
@@ -117,7 +117,7 @@ namespace vc {
 
 		VkRenderPassBeginInfo renderPassInfo = {
 			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-			.renderPass = swapChain->getRenderPass(),
+			.renderPass = overlay ? swapChain->getOverlayRenderPass() : swapChain->getRenderPass(),
 			.framebuffer = swapChain->getFrameBuffer(imageIndex),
 
 			.renderArea = {
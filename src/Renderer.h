@@ -40,8 +40,10 @@ namespace vc {
 
 		void init();
 		VkCommandBuffer startFrame();
-		void endFrame();
-		void startRenderPass(VkCommandBuffer commandBuffer);
+		// waits are extra semaphores the frame's submit has to wait on, like finished uploads
+		void endFrame(const std::vector<SwapChain::Wait>& waits = {});
+		// an overlay pass draws over what is already in the swap chain image instead of clearing it
+		void startRenderPass(VkCommandBuffer commandBuffer, bool overlay = false);
 		void endRenderPass(VkCommandBuffer commandBuffer);
 
 		int getFrameIndex() const { 
@@ -0,0 +1,31 @@
+#include "StagingRing.h"
+
+#include <cstring>
+
+namespace vc {
+	StagingRing::StagingRing(Device& device, VkDeviceSize partitionSize, int partitions) :partitionSize{ partitionSize } {
+		buffer = std::make_unique<Buffer>(
+			device,
+			partitionSize,
+			partitions,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			1
+		);
+		// mapped for the lifetime of the ring, coherent memory needs no flushes
+		buffer->map();
+	}
+
+	void StagingRing::begin(int frameIndex) {
+		base = frameIndex * partitionSize;
+		used = 0;
+	}
+
+	std::optional<VkDeviceSize> StagingRing::push(const void* data, VkDeviceSize size) {
+		if (size > getFree()) return std::nullopt;
+		const VkDeviceSize offset = base + used;
+		std::memcpy(static_cast<char*>(buffer->getMappedMemory()) + offset, data, size);
+		used += size;
+		return offset;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <memory>
+#include <optional>
+
+#include "Buffer.h"
+
+namespace vc {
+	/* Persistently mapped host memory for uploads, split into one partition per frame in flight.
+	 * Copies out of a partition are recorded into the command buffer of the frame that filled it, so the partition
+	 * can be refilled as soon as that frame's fence has signalled, nothing ever waits on a copy of its own.
+	 */
+	class StagingRing {
+		std::unique_ptr<Buffer> buffer;
+		VkDeviceSize partitionSize;
+		VkDeviceSize base = 0;//start of the partition being filled
+		VkDeviceSize used = 0;//bytes of it handed out this frame
+
+	public:
+		StagingRing(Device& device, VkDeviceSize partitionSize, int partitions);
+
+		StagingRing(const StagingRing&) = delete;
+		StagingRing& operator=(const StagingRing&) = delete;
+
+		// starts filling the partition of frameIndex, the frame that used it last must have finished
+		void begin(int frameIndex);
+		// copies size bytes in and returns their offset in the ring, nullopt when the partition has no room left
+		std::optional<VkDeviceSize> push(const void* data, VkDeviceSize size);
+
+		VkBuffer getVkBuffer() const { return buffer->getVkBuffer(); }
+		VkDeviceSize getPartitionSize() const { return partitionSize; }
+		VkDeviceSize getUsed() const { return used; }
+		VkDeviceSize getFree() const { return partitionSize - used; }
+	};
+}
@@ -53,6 +53,7 @@ namespace vc {
     }
 
     vkDestroyRenderPass(device.getVkDevice(), renderPass, nullptr);
+    vkDestroyRenderPass(device.getVkDevice(), overlayRenderPass, nullptr);
 
     // cleanup synchronization objects
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -63,6 +64,9 @@ namespace vc {
   }
 
   VkResult SwapChain::acquireNextImage(uint32_t* imageIndex) {
+    // the command buffer and per frame resources of this slot are reused once its last submission has finished
+    vkWaitForFences(device.getVkDevice(), 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+
   	VkResult result = vkAcquireNextImageKHR(
       device.getVkDevice(),
       swapChain,
@@ -70,12 +74,15 @@ namespace vc {
       imageAvailableSemaphores[currentFrame],  // must be a not signaled semaphore
       VK_NULL_HANDLE,
       imageIndex);
+    if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+      acquiredImage = *imageIndex;
+    }
 
     return result;
   }
 
   VkResult SwapChain::submitCommandBuffers(
-    const VkCommandBuffer* buffers, uint32_t* imageIndex) {
+    const VkCommandBuffer* buffers, uint32_t* imageIndex, const std::vector<Wait>& waits) {
 
 
     VkSubmitInfo submitInfo = {};
@@ -83,18 +90,33 @@ namespace vc {
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = buffers;
 
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.pWaitDstStageMask = waitStages;
-
-    VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    std::vector<VkSemaphore> waitSemaphores = { imageAvailableSemaphores[currentFrame] };
+    std::vector<uint64_t> waitValues = { 0 };
+    for (auto& wait : waits) {
+      waitStages.push_back(wait.stage);
+      waitSemaphores.push_back(wait.semaphore);
+      waitValues.push_back(wait.value);
+    }
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+
+    // timeline semaphores among the waits take their values from here, the binary ones ignore theirs
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    if (!waits.empty()) {
+      submitInfo.pNext = &timelineInfo;
+    }
 
     VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) !=
+    vkResetFences(device.getVkDevice(), 1, &inFlightFences[currentFrame]);
+    if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
       VK_SUCCESS) {
       throw std::runtime_error("failed to submit draw command buffer!");
     }
@@ -256,6 +278,21 @@ namespace vc {
     if (vkCreateRenderPass(device.getVkDevice(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
       throw std::runtime_error("failed to create render pass!");
     }
+
+    // compatible with the first, so it shares its framebuffers and pipelines, but loads the image the ray
+    // tracer copied into and left ready for presentation
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkSubpassDependency overlayDependency = dependency;
+    overlayDependency.srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    overlayDependency.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    overlayDependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    renderPassInfo.pDependencies = &overlayDependency;
+
+    if (vkCreateRenderPass(device.getVkDevice(), &renderPassInfo, nullptr, &overlayRenderPass) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create overlay render pass!");
+    }
   }
 
   void SwapChain::createFramebuffers() {
@@ -19,6 +19,13 @@ namespace vc {
   public:
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
+    // an extra semaphore the frame's submit waits on, value is ignored for binary semaphores
+    struct Wait {
+      VkSemaphore semaphore;
+      uint64_t value;
+      VkPipelineStageFlags stage;
+    };
+
     SwapChain(Device& deviceRef, VkExtent2D windowExtent);
     SwapChain(Device& deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous);
     ~SwapChain();
@@ -28,8 +35,11 @@ namespace vc {
 
     VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
     VkRenderPass getRenderPass() { return renderPass; }
+    // same attachments as the render pass, but keeps what was copied into the presentable image, for drawing over it
+    VkRenderPass getOverlayRenderPass() { return overlayRenderPass; }
     VkImageView getImageView(int index) { return swapChainImageViews[index]; }
-    VkImage getImage() { return swapChainImages[currentFrame]; }
+    // the image acquired for the current frame
+    VkImage getImage() { return swapChainImages[acquiredImage]; }
     size_t imageCount() { return swapChainImages.size(); }
     VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
     VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -42,7 +52,7 @@ namespace vc {
     VkFormat findDepthFormat();
 
     VkResult acquireNextImage(uint32_t* imageIndex);
-    VkResult submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex);
+    VkResult submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex, const std::vector<Wait>& waits = {});
 
     bool compareSwapFormat(const SwapChain& swapChain) const {
       return swapChain.swapChainDepthFormat == swapChainDepthFormat && swapChain.swapChainImageFormat == swapChainImageFormat;
@@ -71,6 +81,7 @@ namespace vc {
 
     std::vector<VkFramebuffer> swapChainFramebuffers;
     VkRenderPass renderPass;
+    VkRenderPass overlayRenderPass;
 
     std::vector<VkImage> depthImages;
     std::vector<VkDeviceMemory> depthImageMemorys;
@@ -89,6 +100,7 @@ namespace vc {
     std::vector<VkFence> inFlightFences;
     std::vector<VkFence> imagesInFlight;
     size_t currentFrame = 0;
+    uint32_t acquiredImage = 0;
   };
 
 }  // namespace lve
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+	workers.reserve(threads);
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		stopping = true;
+		jobs.clear();
+	}
+	available.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::work() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock{ mutex };
+			available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			running++;
+		}
+		job();
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			running--;
+		}
+		idle.notify_all();
+	}
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock{ mutex };
+	idle.wait(lock, [this]() { return jobs.empty() && running == 0; });
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		jobs.push_back(std::move(job));
+	}
+	available.notify_one();
+}
+
+int ThreadPool::queueDepth() {
+	std::lock_guard<std::mutex> lock{ mutex };
+	return static_cast<int>(jobs.size());
+}
+
+unsigned ThreadPool::defaultThreads() {
+	unsigned hardware = std::thread::hardware_concurrency();
+	return hardware > 1 ? hardware - 1 : 1;
+}
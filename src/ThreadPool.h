@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads pulling jobs from a FIFO queue.
+ * Jobs still queued when the pool is destroyed are dropped, running ones are joined. Call wait() first to keep them.
+ */
+class ThreadPool {
+	std::vector<std::thread> workers{};
+	std::deque<std::function<void()>> jobs{};
+	std::mutex mutex{};
+	std::condition_variable available{};
+	std::condition_variable idle{};
+	std::atomic<int> running = 0;
+	bool stopping = false;
+
+	void work();
+public:
+	// defaults to one worker less than the hardware threads so the render thread keeps a core
+	ThreadPool(unsigned threads = defaultThreads());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(std::function<void()> job);
+	// blocks until every queued job has run
+	void wait();
+
+	int queueDepth();
+	int inFlight() const { return running; }
+	int threadCount() const { return static_cast<int>(workers.size()); }
+
+	static unsigned defaultThreads();
+};
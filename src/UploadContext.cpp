@@ -0,0 +1,203 @@
+#include "UploadContext.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace vc {
+	UploadContext::UploadContext(Device& device) :device{ device } {
+		enabledTimelineSemaphoreFeatures.pNext = device.addDeviceFeat(&enabledTimelineSemaphoreFeatures);
+	}
+
+	void UploadContext::init() {
+		QueueFamilyIndices indices = device.findPhysicalQueueFamilies();
+		graphicsFamily = indices.graphicsFamily;
+		family = indices.transferFamilyHasValue ? indices.transferFamily : indices.graphicsFamily;
+		queue = device.transferQueue();
+
+		VkCommandPoolCreateInfo poolInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+			.queueFamilyIndex = family
+		};
+		if (vkCreateCommandPool(device.getVkDevice(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload command pool!");
+		}
+
+		VkSemaphoreTypeCreateInfo typeInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = 0
+		};
+		VkSemaphoreCreateInfo semaphoreInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &typeInfo
+		};
+		if (vkCreateSemaphore(device.getVkDevice(), &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload timeline semaphore!");
+		}
+
+		staging = std::make_unique<Buffer>(
+			device,
+			STAGINGSIZE,
+			1,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			1
+		);
+		// mapped for the lifetime of the context, coherent memory needs no flushes
+		staging->map();
+	}
+
+	UploadContext::~UploadContext() {
+		// the owner waits for the device to go idle first, every batch has finished by now
+		recording.reset();
+		inFlight.clear();
+		staging.reset();
+		if (timeline != VK_NULL_HANDLE)
+			vkDestroySemaphore(device.getVkDevice(), timeline, nullptr);
+		if (commandPool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(device.getVkDevice(), commandPool, nullptr);
+	}
+
+	void UploadContext::collect() {
+		vkGetSemaphoreCounterValue(device.getVkDevice(), timeline, &completed);
+		while (!inFlight.empty() && inFlight.front().value <= completed) {
+			staged -= inFlight.front().staged;
+			vkResetCommandBuffer(inFlight.front().commandBuffer, 0);
+			freeCommandBuffers.push_back(inFlight.front().commandBuffer);
+			inFlight.pop_front();
+		}
+	}
+
+	UploadContext::Batch& UploadContext::batch() {
+		if (recording) return *recording;
+
+		VkCommandBuffer commandBuffer;
+		if (!freeCommandBuffers.empty()) {
+			commandBuffer = freeCommandBuffers.back();
+			freeCommandBuffers.pop_back();
+		}
+		else {
+			VkCommandBufferAllocateInfo allocInfo{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+				.commandPool = commandPool,
+				.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+				.commandBufferCount = 1
+			};
+			if (vkAllocateCommandBuffers(device.getVkDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate upload command buffer!");
+			}
+		}
+
+		VkCommandBufferBeginInfo beginInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+		};
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		recording.emplace(Batch{ .value = 0, .commandBuffer = commandBuffer });
+		return *recording;
+	}
+
+	std::optional<VkDeviceSize> UploadContext::stage(Batch& b, VkDeviceSize size) {
+		// batches finish in submission order, so the space in use is the one stretch that ends at head,
+		// an upload that would cross the end of the ring starts over at 0 and the skipped tail stays with its batch
+		auto fits = [&] {
+			const VkDeviceSize skip = head + size > STAGINGSIZE ? STAGINGSIZE - head : 0;
+			return staged + skip + size <= STAGINGSIZE;
+		};
+		if (!fits()) collect();
+		if (!fits()) return std::nullopt;
+		const VkDeviceSize skip = head + size > STAGINGSIZE ? STAGINGSIZE - head : 0;
+		if (skip > 0) head = 0;
+		const VkDeviceSize offset = head;
+		head += size;
+		staged += skip + size;
+		b.staged += skip + size;
+		return offset;
+	}
+
+	void UploadContext::upload(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize offset) {
+		if (size == 0) return;
+		Batch& b = batch();
+
+		VkBuffer src;
+		VkBufferCopy region{ .srcOffset = 0, .dstOffset = offset, .size = size };
+		if (auto ring = stage(b, size)) {
+			std::memcpy(static_cast<char*>(staging->getMappedMemory()) + *ring, data, size);
+			src = staging->getVkBuffer();
+			region.srcOffset = *ring;
+		}
+		else {
+			auto stager = std::make_unique<Buffer>(
+				device,
+				size,
+				1,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				1
+			);
+			stager->map();
+			stager->writeToBuffer(const_cast<void*>(data), size);
+			stager->unmap();
+			src = stager->getVkBuffer();
+			b.stagers.push_back(std::move(stager));
+		}
+		vkCmdCopyBuffer(b.commandBuffer, src, dst.getVkBuffer(), 1, &region);
+		pending += size;
+
+		if (!isDedicated()) return;
+		// exclusive buffers change hands: released here after the copy, acquired by the frame that waits for it
+		VkBufferMemoryBarrier ownership{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = 0,
+			.srcQueueFamilyIndex = family,
+			.dstQueueFamilyIndex = graphicsFamily,
+			.buffer = dst.getVkBuffer(),
+			.offset = offset,
+			.size = size
+		};
+		vkCmdPipelineBarrier(b.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &ownership, 0, nullptr);
+		ownership.srcAccessMask = 0;
+		ownership.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+		acquires.push_back(ownership);
+	}
+
+	std::optional<SwapChain::Wait> UploadContext::flush(VkCommandBuffer frameCommandBuffer) {
+		collect();
+
+		if (recording) {
+			vkEndCommandBuffer(recording->commandBuffer);
+			recording->value = ++submitted;
+
+			VkTimelineSemaphoreSubmitInfo timelineInfo{
+				.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+				.signalSemaphoreValueCount = 1,
+				.pSignalSemaphoreValues = &recording->value
+			};
+			VkSubmitInfo submitInfo{
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.pNext = &timelineInfo,
+				.commandBufferCount = 1,
+				.pCommandBuffers = &recording->commandBuffer,
+				.signalSemaphoreCount = 1,
+				.pSignalSemaphores = &timeline
+			};
+			if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+				throw std::runtime_error("failed to submit upload command buffer!");
+			}
+			inFlight.push_back(std::move(*recording));
+			recording.reset();
+			pending = 0;
+		}
+
+		// a semaphore wait only holds back the submission it is part of, a later frame reading the same data is not
+		// ordered behind an earlier frame's wait, so each frame waits for the last value until it is known to be reached
+		if (completed >= submitted) return std::nullopt;
+		if (!acquires.empty()) {
+			vkCmdPipelineBarrier(frameCommandBuffer, READERS, READERS, 0, 0, nullptr, static_cast<uint32_t>(acquires.size()), acquires.data(), 0, nullptr);
+			acquires.clear();
+		}
+		return SwapChain::Wait{ .semaphore = timeline, .value = submitted, .stage = READERS };
+	}
+}
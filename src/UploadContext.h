@@ -0,0 +1,82 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Buffer.h"
+#include "SwapChain.h"
+
+namespace vc {
+	/* Copies data into device local buffers on the transfer queue, or on the graphics queue when the device has no
+	 * separate transfer family. Copies are batched until flush, which submits them with a timeline semaphore signal
+	 * and hands the frame the value to wait for, so the CPU never blocks on an upload and the GPU only waits where
+	 * the frame first reads the data. Data is staged in a persistently mapped ring whose space is released once the
+	 * semaphore shows the copy has finished, uploads that do not fit in it get a staging buffer of their own.
+	 */
+	class UploadContext {
+		// the stages a frame reads uploaded data in, the frame's wait and ownership acquire happen there
+		static constexpr VkPipelineStageFlags READERS = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+
+		static constexpr VkDeviceSize STAGINGSIZE = 4 * 1024 * 1024;
+
+		struct Batch {
+			uint64_t value;//the batch is done once the timeline reaches it
+			VkCommandBuffer commandBuffer;
+			VkDeviceSize staged = 0;//ring bytes the batch holds, wrap padding included
+			std::vector<std::unique_ptr<Buffer>> stagers;//for uploads the ring had no room for
+		};
+
+		VkPhysicalDeviceTimelineSemaphoreFeatures enabledTimelineSemaphoreFeatures{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+			.timelineSemaphore = VK_TRUE
+		};
+
+		Device& device;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t family = 0;
+		uint32_t graphicsFamily = 0;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkSemaphore timeline = VK_NULL_HANDLE;
+		uint64_t submitted = 0;//value signalled by the last batch
+		uint64_t completed = 0;//value the timeline had reached at the last collect
+
+		std::unique_ptr<Buffer> staging;
+		VkDeviceSize head = 0;//where the next upload is staged
+		VkDeviceSize staged = 0;//bytes held by batches that are recording or in flight, they end at head
+
+		std::optional<Batch> recording{};
+		std::deque<Batch> inFlight{};
+		std::vector<VkCommandBuffer> freeCommandBuffers{};
+		// ownership transfers released by the transfer queue that the graphics queue still has to acquire
+		std::vector<VkBufferMemoryBarrier> acquires{};
+		VkDeviceSize pending = 0;//bytes recorded since the last flush
+
+		void collect();
+		Batch& batch();
+		// ring offset for size bytes, nullopt when the batches in flight still hold too much of it
+		std::optional<VkDeviceSize> stage(Batch& b, VkDeviceSize size);
+
+	public:
+		// enables timeline semaphores, so it has to be constructed before the device is initialised
+		UploadContext(Device& device);
+		~UploadContext();
+
+		UploadContext(const UploadContext&) = delete;
+		UploadContext& operator=(const UploadContext&) = delete;
+
+		void init();
+
+		// copies size bytes into dst at offset, no frame in flight may be using that part of dst
+		void upload(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+		// submits everything uploaded since the last flush and records the ownership acquires into the frame's
+		// command buffer, the frame has to wait on the returned semaphore value when there is one, every frame is
+		// given it until the timeline shows it reached
+		std::optional<SwapChain::Wait> flush(VkCommandBuffer frameCommandBuffer);
+
+		bool isDedicated() const { return family != graphicsFamily; }
+		size_t getInFlight() const { return inFlight.size(); }
+		VkDeviceSize getPending() const { return pending; }
+	};
+}
@@ -1,5 +1,8 @@
 #include "VisualContext.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "Voxel.h"
 
 #include "imgui.h"
@@ -11,6 +14,7 @@
 namespace vc {
 	VisualContext::VisualContext(){
 		device.init();
+		uploads.init();
 		renderer.init();
 		instanceBuffer = std::make_unique<Buffer>(
 			device,
@@ -20,13 +24,21 @@ namespace vc {
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			1
 		);
-
-		stagingBuffer = std::make_unique<Buffer>(
+		staging = std::make_unique<StagingRing>(device, STAGINGSIZE, SwapChain::MAX_FRAMES_IN_FLIGHT);
+		originBuffer = std::make_unique<Buffer>(
 			device,
-			sizeof(obj::Voxel::Instance),
+			sizeof(obj::Voxel::Origin),
+			ORIGINMAX,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			1
+		);
+		aabbBuffer = std::make_unique<Buffer>(
+			device,
+			sizeof(AABB),
 			INSTANCEMAX,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			1
 		);
 		materialBuffer = std::make_unique<Buffer>(
@@ -47,22 +59,11 @@ namespace vc {
 			device.properties.limits.minUniformBufferOffsetAlignment
 		);
 
-		Buffer msBuffer{
-		device,
-			sizeof(Material),
-			static_cast<uint32_t>(Material::MATERIALS.size()),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			1
-		};
-
 		std::vector<Material::Data> mats{};
 		for(auto i:Material::MATERIALS){
 			mats.emplace_back(i.getData());
 		}
-		msBuffer.map();
-		msBuffer.writeToBuffer((void*)mats.data());
-		device.copyBuffer(msBuffer.getVkBuffer(), materialBuffer->getVkBuffer(), sizeof(mats[0]) * mats.size());
+		uploads.upload(*materialBuffer, mats.data(), sizeof(mats[0]) * mats.size());
 
 		descriptorPool = DescriptorPool::Builder(device)
 			.setMaxSets(3)
@@ -83,17 +84,20 @@ namespace vc {
 		setLayout = DescriptorSetLayout::Builder(device)
 			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
 			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
 			.build();
 		for (int i = 0; i < descriptorSets.size(); ++i) {
 			auto uboInfo = ubo->descriptorInfo();
 			auto matInfo = materialBuffer->descriptorInfo();
+			auto originInfo = originBuffer->descriptorInfo();
 			DescriptorWriter(*setLayout, *descriptorPool)
 				.writeBuffer(0, &uboInfo)
 				.writeBuffer(1, &matInfo)
+				.writeBuffer(2, &originInfo)
 				.build(descriptorSets[i]);
 		}
 
-		voxelRT.init(renderer.getSwapChain(), *instanceBuffer, *materialBuffer);
+		voxelRT.init(renderer.getSwapChain(), *instanceBuffer, *materialBuffer, *originBuffer, *aabbBuffer);
 		//voxelStage.init(setLayout->getDescriptorSetLayout(), renderer.getSwapChain().getRenderPass());
 		//outlineStage.init(setLayout->getDescriptorSetLayout(), renderer.getRenderPass());
 
@@ -126,8 +130,17 @@ namespace vc {
 		ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
 		device.endSingleTimeCommands(command_buffer);
 		UIModule::add([this](){
-			ImGui::Text("Instance count:%d", instanceCount);
-			ImGui::Text("Mapped: %s", (stagingBuffer->getMappedMemory()==nullptr)?"false":"true");
+			ImGui::Text("Instance count:%d (%d in holes), %.1f MB", instances.getUsed(), instances.getHoles(),
+				instances.getUsed() * sizeof(obj::Voxel::Instance) / (1024.f * 1024.f));
+			ImGui::Text("Origins: %d", (int)(originCount - freeOrigins.size()));
+			ImGui::Text("Chunk BLAS: %d, %d rebuilt last frame", (int)voxelRT.getChunkCount(), voxelRT.getBlasBuilds());
+			ImGui::Text("TLAS: %d builds/s, %d refits/s", voxelRT.getTlasBuildsPerSecond(), voxelRT.getTlasRefitsPerSecond());
+			ImGui::Text("AS memory: %.1f of %.1f MB, %.1f MB scratch", voxelRT.getPoolUsed() / (1024.f * 1024.f),
+				voxelRT.getPoolReserved() / (1024.f * 1024.f), voxelRT.getScratchSize() / (1024.f * 1024.f));
+			ImGui::Text("Compacted: %d chunks, %.1f MB -> %.1f MB", voxelRT.getCompactedChunks(),
+				voxelRT.getCompactedFrom() / (1024.f * 1024.f), voxelRT.getCompactedTo() / (1024.f * 1024.f));
+			ImGui::Text("Instance upload: %.1f KB of %.1f KB staging", uploaded / 1024.f, staging->getPartitionSize() / 1024.f);
+			ImGui::Text("Upload queue: %s, %d batches in flight", uploads.isDedicated() ? "transfer" : "graphics", (int)uploads.getInFlight());
 		});
 	}
 
@@ -144,27 +157,165 @@ namespace vc {
 	}
 
 	bool VisualContext::addInstance(obj::Voxel::Instance instance){
-		if(stagingBuffer->getMappedMemory()==nullptr)
-			stagingBuffer->map();
-		stagingBuffer->writeToIndex(&instance, instanceCount);
-		return (++instanceCount < INSTANCEMAX);
+		auto range = allocateInstances(1, UINT64_MAX);
+		if (!range) return false;
+		writeInstance(range->first, instance);
+		return true;
+	}
+
+	std::optional<uint32_t> VisualContext::addOrigin(obj::Voxel::Origin origin) {
+		uint32_t slot;
+		if (!freeOrigins.empty()) {
+			slot = freeOrigins.back();
+			freeOrigins.pop_back();
+		}
+		else if (originCount < ORIGINMAX) slot = originCount++;
+		else return std::nullopt;
+		originData[slot] = origin;
+		dirtyOrigins.push_back({ slot, 1 });
+		return slot;
+	}
+
+	void VisualContext::freeOrigin(uint32_t slot) {
+		// the instances placed against it are hidden or rewritten before the slot is handed out again
+		freeOrigins.push_back(slot);
+	}
+
+	std::optional<InstanceAllocator::Range> VisualContext::allocateInstances(uint32_t count, uint64_t owner) {
+		auto range = instances.allocate(count, owner);
+		// an empty range is not placed anywhere, its first slot may belong to another chunk
+		if (range && range->count > 0) voxelRT.addChunk(range->first, range->count);
+		return range;
+	}
+
+	void VisualContext::writeInstance(uint32_t slot, const obj::Voxel::Instance& instance) {
+		instanceData[slot] = instance;
+		markDirty(slot, 1);
+	}
+
+	// chunks write their slots in order, so most writes just extend the last range
+	static void extend(std::vector<InstanceAllocator::Range>& ranges, uint32_t first, uint32_t count) {
+		if (!ranges.empty() && ranges.back().first + ranges.back().count == first)
+			ranges.back().count += count;
+		else
+			ranges.push_back({ first, count });
+	}
+
+	void VisualContext::markDirty(uint32_t first, uint32_t count) {
+		extend(dirty, first, count);
+	}
+
+	void VisualContext::freeInstances(InstanceAllocator::Range range) {
+		if (range.count == 0) return;
+		// holes stay below the high water mark until compacted, a default instance has no origin and is not drawn
+		for (uint32_t i = 0; i < range.count; i++)
+			writeInstance(range.first + i, obj::Voxel::Instance{});
+		instances.free(range);
+		voxelRT.removeChunk(range.first);
+	}
+
+	bool VisualContext::resizeInstances(InstanceAllocator::Range& range, uint32_t count) {
+		InstanceAllocator::Range before = range;
+		if (!instances.resize(range, count)) return false;
+		for (uint32_t i = count; i < before.count; i++)
+			writeInstance(before.first + i, obj::Voxel::Instance{});
+		// shrinking to nothing frees the range and leaves it empty, at slot 0
+		if (count == 0) voxelRT.removeChunk(before.first);
+		else voxelRT.resizeChunk(before.first, count);
+		return true;
+	}
+
+	void VisualContext::moveInstances(InstanceAllocator::Range from, uint32_t to) {
+		if (from.count == 0) return;
+		std::memmove(&instanceData[to], &instanceData[from.first], from.count * sizeof(obj::Voxel::Instance));
+		markDirty(to, from.count);
+	}
+
+	std::vector<InstanceAllocator::Move> VisualContext::compactInstances(uint32_t budget) {
+		auto moves = instances.compact(budget);
+		for (auto& move : moves) {
+			moveInstances(move.from, move.to);
+			voxelRT.moveChunk(move.from.first, move.to);
+		}
+		return moves;
+	}
+
+	// one copy region per run of dirty slots, overlapping and touching ranges go out together
+	static std::vector<VkBufferCopy> coalesce(std::vector<InstanceAllocator::Range>& dirty, VkDeviceSize stride) {
+		std::sort(dirty.begin(), dirty.end(), [](auto& a, auto& b) { return a.first < b.first; });
+		std::vector<VkBufferCopy> regions{};
+		uint32_t first = dirty[0].first, last = first;
+		for (auto& range : dirty) {
+			if (range.first > last) {
+				regions.push_back({ first * stride, first * stride, (last - first) * stride });
+				first = range.first;
+			}
+			last = std::max(last, range.first + range.count);
+		}
+		regions.push_back({ first * stride, first * stride, (last - first) * stride });
+		dirty.clear();
+		return regions;
+	}
+
+	std::vector<VkBufferCopy> VisualContext::stage(std::vector<InstanceAllocator::Range>& ranges, const void* data, VkDeviceSize stride) {
+		if (ranges.empty()) return {};
+		std::vector<VkBufferCopy> copies{};
+		for (auto& region : coalesce(ranges, stride)) {
+			// what does not fit in this frame's partition stays dirty for the next one
+			const VkDeviceSize size = std::min(region.size, staging->getFree() / stride * stride);
+			if (size > 0) {
+				copies.push_back({ *staging->push(static_cast<const char*>(data) + region.srcOffset, size), region.dstOffset, size });
+				uploaded += size;
+			}
+			if (size < region.size)
+				ranges.push_back({ static_cast<uint32_t>((region.dstOffset + size) / stride), static_cast<uint32_t>((region.size - size) / stride) });
+		}
+		return copies;
+	}
+
+	void VisualContext::upload(VkCommandBuffer commandBuffer, int frameIndex) {
+		staging->begin(frameIndex);
+		uploaded = 0;
+		// the AABBs of arriving instances are computed from their origins on the device, so origins go first and
+		// instances wait for the next frame while any origin is still left behind
+		auto originCopies = stage(dirtyOrigins, originData.data(), sizeof(obj::Voxel::Origin));
+		auto instanceCopies = dirtyOrigins.empty() ? stage(dirty, instanceData.data(), sizeof(obj::Voxel::Instance)) : std::vector<VkBufferCopy>{};
+		if (instanceCopies.empty() && originCopies.empty()) return;
+		// the AABBs of the slots that arrive are rewritten from them on the device, their chunks are rebuilt
+		// whenever a part of them arrives, also when the rest only follows next frame
+		for (auto& copy : instanceCopies)
+			voxelRT.markDirty(static_cast<uint32_t>(copy.dstOffset / sizeof(obj::Voxel::Instance)), static_cast<uint32_t>(copy.size / sizeof(obj::Voxel::Instance)));
+
+		// the previous frame may still be reading the slots about to be overwritten
+		const VkPipelineStageFlags readers = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		vkCmdPipelineBarrier(commandBuffer, readers, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		if (!instanceCopies.empty())
+			vkCmdCopyBuffer(commandBuffer, staging->getVkBuffer(), instanceBuffer->getVkBuffer(), static_cast<uint32_t>(instanceCopies.size()), instanceCopies.data());
+		if (!originCopies.empty())
+			vkCmdCopyBuffer(commandBuffer, staging->getVkBuffer(), originBuffer->getVkBuffer(), static_cast<uint32_t>(originCopies.size()), originCopies.data());
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, readers, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 	}
 
 	void VisualContext::renderFrame(){
 		if (auto commandBuffer = renderer.startFrame()) {
-		/*	ImGui_ImplVulkan_NewFrame();
+			ImGui_ImplVulkan_NewFrame();
 			ImGui_ImplGlfw_NewFrame();
 			ImGui::NewFrame();
-			ImGui::ShowDemoWindow();
+			//ImGui::ShowDemoWindow();
 			ImGui::Begin("Debug window");
-			UIModule::render();*/
-
-			if(stagingBuffer->getMappedMemory()!=nullptr)
-				stagingBuffer->unmap();
-			device.copyBuffer(stagingBuffer->getVkBuffer(), instanceBuffer->getVkBuffer(), stagingBuffer->getInstanceSize()*instanceCount);
+			UIModule::render();
 
-			
 			int frameIndex = renderer.getFrameIndex();
+			upload(commandBuffer, frameIndex);
+			std::vector<SwapChain::Wait> waits{};
+			if (auto wait = uploads.flush(commandBuffer))
+				waits.push_back(*wait);
 
 			UniformBuffer data;
 			data.projectionView = camera->getProjection() * camera->getView();
@@ -186,21 +337,24 @@ namespace vc {
 			};
 
 			delta = now - start;
-			//ImGui::Text("FPS: %f", (frames++)/delta.count());
+			ImGui::Text("FPS: %f", (frames++)/delta.count());
 			if(delta.count()>1){
 				start = now;
 				frames = 0;
 			}
 
-			//ImGui::End();
-			//ImGui::Render();
+			ImGui::End();
+			ImGui::Render();
 			//renderer.startRenderPass(commandBuffer);
 			//voxelStage.renderVoxels(frameInfo, instanceCount);
-			//ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
 			//renderer.endRenderPass(commandBuffer);
 
-			voxelRT.render(frameInfo,renderer.getSwapChain(), *instanceBuffer, *materialBuffer);
-			renderer.endFrame();
+			voxelRT.render(frameInfo,renderer.getSwapChain(), *instanceBuffer, *materialBuffer, *originBuffer);
+			// the debug window goes over the traced image
+			renderer.startRenderPass(commandBuffer, true);
+			ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+			renderer.endRenderPass(commandBuffer);
+			renderer.endFrame(waits);
 
 		}
 	}
@@ -2,8 +2,11 @@
 #include <chrono>
 
 #include "Descriptor.h"
+#include "InstanceAllocator.h"
 #include "OutlineRenderer.h"
 #include "Renderer.h"
+#include "StagingRing.h"
+#include "UploadContext.h"
 #include "VoxelRayTracer.h"
 #include "VoxelRenderer.h"
 
@@ -17,20 +20,32 @@ namespace vc {
 		static constexpr int WIDTH = 854;
 		static constexpr int HEIGHT = 480;
 		static constexpr uint32_t INSTANCEMAX = 1000000;
+		static constexpr uint32_t ORIGINMAX = obj::Voxel::Instance::HIDDEN;
+		static constexpr VkDeviceSize STAGINGSIZE = 2 << 20;//bytes uploaded per frame at most, the rest goes out with the next ones
 
 		Window window{ WIDTH,HEIGHT, "Window" };
 		Device device{ window };
 		Renderer renderer{ window, device };
 		//VoxelRenderer voxelStage{ device };
 		VoxelRayTracer voxelRT{ device };
+		UploadContext uploads{ device };//one-off uploads, per frame instance writes go through staging instead
 		//OutlineRenderer outlineStage{ device };
 
 		//data section (should probably be a separate class)
 		std::unique_ptr<Buffer> instanceBuffer;
-		std::unique_ptr<Buffer> stagingBuffer;
 		std::unique_ptr<Buffer> materialBuffer;
-		int instanceCount = 0;
-		int instancePlus = 0;
+		std::unique_ptr<Buffer> originBuffer;
+		std::unique_ptr<Buffer> aabbBuffer;//world space bounds of every instance slot, the chunks' ray tracing geometry, written by voxelRT
+		std::unique_ptr<StagingRing> staging;
+		// host copies of the device buffers, writes land here and only the dirty ranges are staged
+		std::vector<obj::Voxel::Instance> instanceData = std::vector<obj::Voxel::Instance>(INSTANCEMAX);
+		std::vector<obj::Voxel::Origin> originData = std::vector<obj::Voxel::Origin>(ORIGINMAX);
+		InstanceAllocator instances{ INSTANCEMAX };
+		std::vector<InstanceAllocator::Range> dirty{};//slots written since the last upload
+		std::vector<uint32_t> freeOrigins{};
+		uint32_t originCount = 0;//high water mark of the origin table
+		std::vector<InstanceAllocator::Range> dirtyOrigins{};
+		VkDeviceSize uploaded = 0;//bytes copied to the device by the last frame
 
 		std::unique_ptr<Buffer> ubo;
 		std::unique_ptr<DescriptorPool> descriptorPool{};
@@ -42,6 +57,11 @@ namespace vc {
 		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 		long frames = 0;
 
+		void markDirty(uint32_t first, uint32_t count);
+		// records the copies of everything written since the last frame into its command buffer
+		void upload(VkCommandBuffer commandBuffer, int frameIndex);
+		std::vector<VkBufferCopy> stage(std::vector<InstanceAllocator::Range>& ranges, const void* data, VkDeviceSize stride);
+
 	public:
 		VisualContext();
 		~VisualContext();
@@ -51,7 +71,26 @@ namespace vc {
 		void renderFrame();
 
 		bool addInstance(obj::Voxel::Instance instance);
-		void clearInstances() { instanceCount = 0; }
+		void clearInstances() {
+			instances.clear();
+			voxelRT.clearChunks();
+			freeOrigins.clear();
+			originCount = 0;
+		}
+
+		// instances are placed relative to an origin, one per chunk
+		std::optional<uint32_t> addOrigin(obj::Voxel::Origin origin);
+		void freeOrigin(uint32_t slot);
+
+		// slots are drawn until freed, owner is handed back when compaction moves them
+		std::optional<InstanceAllocator::Range> allocateInstances(uint32_t count, uint64_t owner);
+		void writeInstance(uint32_t slot, const obj::Voxel::Instance& instance);
+		void freeInstances(InstanceAllocator::Range range);
+		// in place, the slots dropped from the end are hidden, false when growing would need a move
+		bool resizeInstances(InstanceAllocator::Range& range, uint32_t count);
+		void moveInstances(InstanceAllocator::Range from, uint32_t to);
+		// moves up to budget instances into holes, the caller updates the ranges it owns
+		std::vector<InstanceAllocator::Move> compactInstances(uint32_t budget);
 	};
 }
 
@@ -16,12 +16,6 @@ namespace obj {
 	const uint32_t Voxel::VertexCount = static_cast<uint32_t> (Vertices.size());
 	const uint32_t Voxel::IndexCount = static_cast<uint32_t> (Indices.size());
 
-	Voxel::Voxel(Instance ins) :Base{ {ins.position,ins.rotation,ins.scale} }, materialID{ins.materialID} {}
-
-	Voxel::Instance Voxel::getInstance(){
-		return Instance{ transform.position,transform.rotation,transform.scale,materialID };
-	}
-
 
 	std::vector<VkVertexInputBindingDescription> Voxel::getBindingDescription() {
 		return {
@@ -33,10 +27,7 @@ namespace obj {
 	std::vector<VkVertexInputAttributeDescription> Voxel::getAttributeDescriptions() {
 		return {
 			{0,0,VK_FORMAT_R32G32B32_SFLOAT, 0},
-			{1,1,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Instance, position)},
-			{2,1,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Instance, scale)},
-			{3,1,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Instance, rotation) },
-			{4,1,VK_FORMAT_R32_UINT, offsetof(Instance, materialID)},// material index
+			{1,1,VK_FORMAT_R32G32_UINT, offsetof(Instance, position)},// position and ids, unpacked in the shader
 		};
 	}
 }
\ No newline at end of file
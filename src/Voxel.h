@@ -1,18 +1,39 @@
 #pragma once
-#include "Object.h"
+#include <cstdint>
 #include <vector>
 #include <glm/vec3.hpp>
 
 #include <vulkan/vulkan_core.h>
 
 namespace obj {
-	class Voxel : public Base {
+	/* Voxels have no object identity, they only exist as Instance records in chunk storage and the instance buffer.
+	 * This class describes their shared cube mesh and the instance layout, only dynamic entities are obj::Base objects.
+	 */
+	class Voxel {
 	public:
+		// 8 bytes, decoded against the origin table in shaders/instance.glsl
 		struct Instance {
+			static constexpr uint32_t HIDDEN = 0xFFFF;//origin of unused slots, they are not drawn
+			static constexpr int MAXCOORD = 1023;
+
+			uint32_t position = 0;//x, y, z in voxels from the origin, 10 bits each, the top 2 bits are the size as a power of two voxels
+			uint32_t ids = HIDDEN;//origin table slot in the low 16 bits, material in the high 16
+
+			Instance() = default;
+			Instance(glm::ivec3 voxel, uint32_t material, uint32_t origin = 0, uint32_t sizeExponent = 0) :
+				position{ uint32_t(voxel.x) | uint32_t(voxel.y) << 10 | uint32_t(voxel.z) << 20 | sizeExponent << 30 },
+				ids{ origin | material << 16 } {}
+
+			glm::ivec3 voxel() const { return { position & MAXCOORD, (position >> 10) & MAXCOORD, (position >> 20) & MAXCOORD }; }
+			uint32_t sizeExponent() const { return position >> 30; }
+			uint32_t origin() const { return ids & 0xFFFF; }
+			uint32_t material() const { return ids >> 16; }
+			void setOrigin(uint32_t origin) { ids = (ids & 0xFFFF0000u) | origin; }
+		};
+		// one per chunk, instances are placed at position + voxel * voxelSize
+		struct Origin {
 			glm::vec3 position{};
-			alignas(16) glm::vec3 scale{ 1.f };
-			alignas(16) glm::vec3 rotation{};
-			alignas(4) uint32_t materialID = 0;
+			float voxelSize = 1.f;
 		};
 
 		static const std::vector<glm::vec3> Vertices;
@@ -23,9 +44,7 @@ namespace obj {
 		static std::vector<VkVertexInputBindingDescription> getBindingDescription();
 		static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
 
-		Voxel(Instance instance);
-		Instance getInstance();
-	private:
-		uint32_t materialID;
+		Voxel() = delete;
 	};
+	static_assert(sizeof(Voxel::Instance) == 8);
 }
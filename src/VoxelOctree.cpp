@@ -0,0 +1,124 @@
+#include "VoxelOctree.h"
+
+#include <algorithm>
+#include <limits>
+
+VoxelOctree::VoxelOctree(const ChunkVolume& volume) {
+	root = build(volume, 0, 0, 0, SIZE);
+	nodes.shrink_to_fit();
+}
+
+// children are ordered x, then y, then z: bit 0 of the index is the upper half along x
+uint32_t VoxelOctree::build(const ChunkVolume& volume, int x, int y, int z, int size) {
+	if (x >= ChunkVolume::SIZE || y >= ChunkVolume::HEIGHT || z >= ChunkVolume::SIZE) return EMPTY;
+	if (size == 1) return encode(volume.get(x, y, z));
+
+	const int half = size / 2;
+	uint32_t children[8];
+	for (int i = 0; i < 8; i++)
+		children[i] = build(volume, x + (i & 1) * half, y + ((i >> 1) & 1) * half, z + ((i >> 2) & 1) * half, half);
+
+	// leaves never add nodes, so collapsing them leaves nothing orphaned behind
+	if (!(children[0] & BRANCH) && std::all_of(children + 1, children + 8, [&](uint32_t c) { return c == children[0]; }))
+		return children[0];
+	uint32_t first = static_cast<uint32_t>(nodes.size());
+	nodes.insert(nodes.end(), children, children + 8);
+	return BRANCH | first;
+}
+
+ChunkVolume VoxelOctree::toDense() const {
+	ChunkVolume volume{};
+	fill(volume, root, 0, 0, 0, SIZE);
+	return volume;
+}
+
+void VoxelOctree::fill(ChunkVolume& volume, uint32_t node, int x, int y, int z, int size) const {
+	if (x >= ChunkVolume::SIZE || y >= ChunkVolume::HEIGHT || z >= ChunkVolume::SIZE) return;
+	if (node & BRANCH) {
+		const int half = size / 2;
+		for (int i = 0; i < 8; i++)
+			fill(volume, nodes[(node & ~BRANCH) + i], x + (i & 1) * half, y + ((i >> 1) & 1) * half, z + ((i >> 2) & 1) * half, half);
+		return;
+	}
+	if (node == EMPTY) return;//a new volume is all air
+	for (int vx = x; vx < std::min(x + size, ChunkVolume::SIZE); vx++)
+		for (int vz = z; vz < std::min(z + size, ChunkVolume::SIZE); vz++)
+			for (int vy = y; vy < std::min(y + size, ChunkVolume::HEIGHT); vy++)
+				volume.set(vx, vy, vz, decode(node));
+}
+
+VoxelOctree::Leaf VoxelOctree::findLeaf(glm::ivec3 voxel) const {
+	if (voxel.x < 0 || voxel.y < 0 || voxel.z < 0 || voxel.x >= SIZE || voxel.y >= SIZE || voxel.z >= SIZE)
+		return { voxel, 1, ChunkVolume::AIR };
+
+	uint32_t node = root;
+	glm::ivec3 min{ 0 };
+	int size = SIZE;
+	while (node & BRANCH) {
+		size /= 2;
+		int i = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			if (voxel[axis] >= min[axis] + size) {
+				min[axis] += size;
+				i |= 1 << axis;
+			}
+		}
+		node = nodes[(node & ~BRANCH) + i];
+	}
+	return { min, size, decode(node) };
+}
+
+bool VoxelOctree::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, Hit& hit) const {
+	const float INF = std::numeric_limits<float>::infinity();
+	glm::vec3 d = direction / glm::length(direction);
+
+	// clip the ray to the octree cube
+	float enter = 0, exit = maxDistance;
+	int enterAxis = -1;
+	for (int axis = 0; axis < 3; axis++) {
+		if (d[axis] == 0) {
+			if (origin[axis] < 0 || origin[axis] >= SIZE) return false;
+			continue;
+		}
+		float t0 = (0 - origin[axis]) / d[axis];
+		float t1 = (SIZE - origin[axis]) / d[axis];
+		if (t0 > t1) std::swap(t0, t1);
+		if (t0 > enter) {
+			enter = t0;
+			enterAxis = axis;
+		}
+		exit = std::min(exit, t1);
+	}
+	if (enter > exit) return false;
+
+	glm::ivec3 normal{ 0 };
+	if (enterAxis >= 0) normal[enterAxis] = d[enterAxis] > 0 ? -1 : 1;
+	float t = enter;
+	while (t <= exit) {
+		// nudged along the ray so points on a cube face land in the cube being entered
+		glm::vec3 p = origin + d * (t + 1e-4f);
+		glm::ivec3 voxel = glm::clamp(glm::ivec3(glm::floor(p)), glm::ivec3(0), glm::ivec3(SIZE - 1));
+		Leaf leaf = findLeaf(voxel);
+		if (leaf.material != ChunkVolume::AIR) {
+			hit = { voxel, normal, t, leaf.material };
+			return true;
+		}
+
+		// step to where the ray leaves the empty cube
+		float next = INF;
+		int axis = 0;
+		for (int a = 0; a < 3; a++) {
+			if (d[a] == 0) continue;
+			float bound = d[a] > 0 ? leaf.min[a] + leaf.size : leaf.min[a];
+			float ta = (bound - origin[a]) / d[a];
+			if (ta < next) {
+				next = ta;
+				axis = a;
+			}
+		}
+		normal = glm::ivec3{ 0 };
+		normal[axis] = d[axis] > 0 ? -1 : 1;
+		t = std::max(next, t + 1e-4f);//always make progress, even when rounding puts the exit behind t
+	}
+	return false;
+}
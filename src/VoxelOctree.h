@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ChunkVolume.h"
+
+/* Sparse voxel octree of one chunk. Subtrees of a single material collapse into one leaf, which
+ * keeps the empty sky and the solid ground below the surface down to a handful of nodes.
+ * The cube is the next power of two around the ChunkVolume, everything outside the volume is air.
+ * Nodes are 32 bits, either a leaf material or BRANCH | index of 8 contiguous children.
+ */
+class VoxelOctree {
+public:
+	static constexpr int SIZE = 256;
+	static_assert(SIZE >= ChunkVolume::SIZE && SIZE >= ChunkVolume::HEIGHT, "the octree must cover the whole volume");
+
+	struct Leaf {
+		glm::ivec3 min;
+		int size;
+		uint32_t material;
+	};
+
+	struct Hit {
+		glm::ivec3 voxel;
+		glm::ivec3 normal;//face the ray entered through, zero when it started inside the voxel
+		float distance;
+		uint32_t material;
+	};
+
+	VoxelOctree(const ChunkVolume& volume);
+	ChunkVolume toDense() const;
+
+	uint32_t get(int x, int y, int z) const { return findLeaf({ x, y, z }).material; }
+	// largest uniform cube containing the voxel
+	Leaf findLeaf(glm::ivec3 voxel) const;
+	// origin and distances are in voxels from the chunk's first voxel, uniform empty cubes are crossed in one step
+	bool raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, Hit& hit) const;
+
+	size_t getNodeCount() const { return nodes.size() + 1; }
+	size_t getMemoryUsage() const { return sizeof(VoxelOctree) + nodes.capacity() * sizeof(uint32_t); }
+private:
+	static constexpr uint32_t BRANCH = 0x80000000u;
+	static constexpr uint32_t EMPTY = ChunkVolume::AIR & ~BRANCH;
+
+	uint32_t root;
+	std::vector<uint32_t> nodes{};
+
+	static uint32_t encode(uint32_t material) { return material == ChunkVolume::AIR ? EMPTY : material; }
+	static uint32_t decode(uint32_t node) { return node == EMPTY ? ChunkVolume::AIR : node; }
+
+	uint32_t build(const ChunkVolume& volume, int x, int y, int z, int size);
+	void fill(ChunkVolume& volume, uint32_t node, int x, int y, int z, int size) const;
+};
@@ -1,6 +1,7 @@
 #include "VoxelRayTracer.h"
 
 #include "Voxel.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -166,8 +167,17 @@ namespace vc{
 	VoxelRayTracer::~VoxelRayTracer(){
 		vkDestroyPipeline(device.getVkDevice(), pipeline, nullptr);
 		vkDestroyPipelineLayout(device.getVkDevice(), pipelineLayout, nullptr);
-		deleteAccelerationStructure(bottomLevelAS);
+		vkDestroyQueryPool(device.getVkDevice(), compactionQueries, nullptr);
+		vkDestroyPipeline(device.getVkDevice(), aabbPipeline, nullptr);
+		vkDestroyPipelineLayout(device.getVkDevice(), aabbPipelineLayout, nullptr);
+		for (auto& [first, chunk] : chunks)
+			deleteAccelerationStructure(chunk.blas);
+		deleteRetired(released);
+		for (auto& frame : retired)
+			deleteRetired(frame);
 		deleteAccelerationStructure(topLevelAS);
+		deleteAccelerationStructure(emptyAS);
+		deleteScratchBuffer(scratch);
 	}
 
 	void VoxelRayTracer::createStorageImage(VkFormat format, VkExtent3D extent){
@@ -239,13 +249,13 @@ namespace vc{
 		vkDestroyImage(device.getVkDevice(), storageImage.image, nullptr);
 		vkFreeMemory(device.getVkDevice(), storageImage.memory, nullptr);
 	}
-	void VoxelRayTracer::createDescriptorSets(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer){
+	void VoxelRayTracer::createDescriptorSets(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer, Buffer& oBuffer){
 		descriptorPool = DescriptorPool::Builder(device)
 		.setMaxSets(1)
 		.addPoolSize(VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1)
 		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1)
 		.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)
-			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3)
 		.build();
 		auto sl = setLayout->getDescriptorSetLayout();
 		VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{
@@ -307,12 +317,22 @@ namespace vc{
 		matWrite.pBufferInfo = &matDesc;
 		matWrite.descriptorCount = 1;
 
+		auto originDesc = oBuffer.descriptorInfo();
+		VkWriteDescriptorSet originWrite{};
+		originWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		originWrite.dstSet = descriptorSet;
+		originWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		originWrite.dstBinding = 5;
+		originWrite.pBufferInfo = &originDesc;
+		originWrite.descriptorCount = 1;
+
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 			accelerationStructureWrite,
 			imageWrite,
 			uboWrite,
 			instWrite,
-			matWrite
+			matWrite,
+			originWrite
 		};
 		vkUpdateDescriptorSets(device.getVkDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, VK_NULL_HANDLE);
 	}
@@ -327,121 +347,435 @@ namespace vc{
 		enabledAccelerationStructureFeatures.pNext = device.addDeviceFeat(&enabledAccelerationStructureFeatures);
 	}
 
-	void VoxelRayTracer::createBottomLevelAS(){
-		AABB aabb{  -glm::vec3(0.5f,0.5f,0.5f),glm::vec3(0.5f,0.5f,0.5f) };
-		Buffer aabbsStager{
-				device,
-				sizeof(AABB),
-				1,
-				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-		};
-		aabbsStager.map();
-		aabbsStager.writeToBuffer(&aabb);
-		
-		Buffer aabbsBuffer{
+	void VoxelRayTracer::createTopLevelAS(){
+		// created once for CHUNKMAX instances and built or refitted in place, chunks only change what is in it
+		topLevelInstances = std::make_unique<Buffer>(
 			device,
-			sizeof(AABB),
-			1,
-			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-		};
+			sizeof(VkAccelerationStructureInstanceKHR),
+			CHUNKMAX * SwapChain::MAX_FRAMES_IN_FLIGHT,
+			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			1
+		);
+		topLevelInstances->map();
 
-		device.copyBuffer(aabbsStager.getVkBuffer(), aabbsBuffer.getVkBuffer(), sizeof(AABB));
-		// Build
 		VkAccelerationStructureGeometryKHR accelerationStructureGeometry{};
 		accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+		accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
 		accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-		accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_AABBS_KHR;
-		accelerationStructureGeometry.geometry.aabbs.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR;		accelerationStructureGeometry.geometry.aabbs.data.deviceAddress = getBufferDeviceAddress(aabbsBuffer.getVkBuffer());
-		accelerationStructureGeometry.geometry.aabbs.stride = sizeof(AABB);
+		accelerationStructureGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+		accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
 
-		// Get size info
 		VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo{};
 		accelerationStructureBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-		accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-		accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+		accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+		accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
 		accelerationStructureBuildGeometryInfo.geometryCount = 1;
 		accelerationStructureBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
 
-		const uint32_t numTriangles = static_cast<uint32_t>(obj::Voxel::IndexCount / 3);
-
+		const uint32_t maxInstances = CHUNKMAX;
 		VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo{};
 		accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
 		vkGetAccelerationStructureBuildSizesKHR(
 			device.getVkDevice(),
 			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
 			&accelerationStructureBuildGeometryInfo,
-			&numTriangles,
+			&maxInstances,
 			&accelerationStructureBuildSizesInfo);
 
-		createAccelerationStructure(bottomLevelAS, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, accelerationStructureBuildSizesInfo);
+		createAccelerationStructure(topLevelAS, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, accelerationStructureBuildSizesInfo);
+		reserveScratch(std::max(accelerationStructureBuildSizesInfo.buildScratchSize, accelerationStructureBuildSizesInfo.updateScratchSize));
+		createEmptyAS();
+		changed = true;//never traced before its first build
+	}
 
-		VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
-		accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-		accelerationStructureCreateInfo.buffer = bottomLevelAS.buffer;
-		accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
-		accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-		vkCreateAccelerationStructureKHR(device.getVkDevice(), &accelerationStructureCreateInfo, nullptr, &bottomLevelAS.handle);
+	void VoxelRayTracer::createEmptyAS(){
+		VkAccelerationStructureGeometryKHR geometry{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+			.geometryType = VK_GEOMETRY_TYPE_AABBS_KHR,
+			.geometry = {.aabbs = {
+				.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR,
+				.data = {.deviceAddress = aabbAddress },
+				.stride = sizeof(AABB)
+			} },
+			.flags = VK_GEOMETRY_OPAQUE_BIT_KHR
+		};
+		VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
+			.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+			.geometryCount = 1,
+			.pGeometries = &geometry
+		};
+		const uint32_t primitiveCount = 0;
+		VkAccelerationStructureBuildSizesInfoKHR sizes{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+		vkGetAccelerationStructureBuildSizesKHR(device.getVkDevice(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &primitiveCount, &sizes);
+		createAccelerationStructure(emptyAS, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizes);
+
+		// built once at startup, like the storage image's layout transition
+		buildInfo.dstAccelerationStructure = emptyAS.handle;
+		buildInfo.scratchData.deviceAddress = reserveScratch(sizes.buildScratchSize);
+		VkAccelerationStructureBuildRangeInfoKHR rangeInfo{ .primitiveCount = primitiveCount };
+		const VkAccelerationStructureBuildRangeInfoKHR* rangeInfoPointer = &rangeInfo;
+		VkCommandBuffer cmdBuffer = device.beginSingleTimeCommands();
+		vkCmdBuildAccelerationStructuresKHR(cmdBuffer, 1, &buildInfo, &rangeInfoPointer);
+		device.endSingleTimeCommands(cmdBuffer);
+	}
 
-		// Create a small scratch buffer used during build of the bottom level acceleration structure
-		ScratchBuffer scratchBuffer = createScratchBuffer(accelerationStructureBuildSizesInfo.buildScratchSize);
+	void VoxelRayTracer::retire(AccelerationStructure& accelerationStructure){
+		if (accelerationStructure.handle != VK_NULL_HANDLE)
+			released.structures.push_back(accelerationStructure);
+		accelerationStructure = {};
+	}
 
-		VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo{};
-		accelerationBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-		accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-		accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-		accelerationBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-		accelerationBuildGeometryInfo.dstAccelerationStructure = bottomLevelAS.handle;
-		accelerationBuildGeometryInfo.geometryCount = 1;
-		accelerationBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-		accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
+	void VoxelRayTracer::releaseInstance(ChunkAS& chunk){
+		if (chunk.instance == NOINSTANCE) return;
+		freeInstances.push_back(chunk.instance);
+		chunk.instance = NOINSTANCE;
+		changed = true;
+	}
 
-		VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
-		accelerationStructureBuildRangeInfo.primitiveCount = numTriangles;
-		accelerationStructureBuildRangeInfo.primitiveOffset = 0;
-		accelerationStructureBuildRangeInfo.firstVertex = 0;
-		accelerationStructureBuildRangeInfo.transformOffset = 0;
-		std::vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfos = { &accelerationStructureBuildRangeInfo };
-
-		// Build the acceleration structure on the device via a one-time command buffer submission
-		// Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
-		VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
-		vkCmdBuildAccelerationStructuresKHR(
-			commandBuffer,
-			1,
-			&accelerationBuildGeometryInfo,
-			accelerationBuildStructureRangeInfos.data());
-		device.endSingleTimeCommands(commandBuffer);
+	void VoxelRayTracer::resetCompaction(ChunkAS& chunk){
+		if (chunk.fullSize > 0) {
+			compactedChunks--;
+			compactedFrom -= chunk.fullSize;
+			compactedTo -= chunk.blas.size;
+		}
+		chunk.fullSize = 0;
+		chunk.age = 0;
+		chunk.compacting = false;
+	}
 
-		VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
-		accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-		accelerationDeviceAddressInfo.accelerationStructure = bottomLevelAS.handle;
-		bottomLevelAS.deviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device.getVkDevice(), &accelerationDeviceAddressInfo);
+	void VoxelRayTracer::dropStructure(ChunkAS& chunk){
+		releaseInstance(chunk);
+		resetCompaction(chunk);
+		retire(chunk.blas);
+	}
 
-		deleteScratchBuffer(scratchBuffer);
+	void VoxelRayTracer::deleteRetired(Retired& frame){
+		for (auto& structure : frame.structures)
+			deleteAccelerationStructure(structure);
+		for (auto& scratch : frame.scratch)
+			deleteScratchBuffer(scratch);
+		frame = {};
 	}
 
-	void VoxelRayTracer::createTopLevelAS(){
-		VkTransformMatrixKHR transformMatrix = {
-	1.0f, 0.0f, 0.0f, 0.0f,
-	0.0f, 1.0f, 0.0f, 0.0f,
-	0.0f, 0.0f, 1.0f, 8.0f };
-
-		VkAccelerationStructureInstanceKHR instance{};
-		instance.transform = transformMatrix;
-		instance.instanceCustomIndex = 0;
-		instance.mask = 0xFF;
-		instance.instanceShaderBindingTableRecordOffset = 0;
-		instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-		instance.accelerationStructureReference = bottomLevelAS.deviceAddress;
-
-		stagingBuffer->map();
-		stagingBuffer->writeToBuffer(&instance);
-		stagingBuffer->unmap();
-
-		VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress{};
-		instanceDataDeviceAddress.deviceAddress = getBufferDeviceAddress(stagingBuffer->getVkBuffer());
+	uint64_t VoxelRayTracer::reserveScratch(VkDeviceSize size){
+		if (size > scratchSize) {
+			// frames in flight may still be building with the old one
+			if (scratch.handle != VK_NULL_HANDLE)
+				released.scratch.push_back(scratch);
+			scratch = createScratchBuffer(size);
+			scratchSize = size;
+		}
+		return scratch.deviceAddress;
+	}
+
+	void VoxelRayTracer::addChunk(uint32_t first, uint32_t count){
+		auto [it, inserted] = chunks.try_emplace(first, ChunkAS{ .count = count });
+		if (!inserted) {
+			dropStructure(it->second);
+			it->second = ChunkAS{ .count = count };
+		}
+	}
+
+	void VoxelRayTracer::removeChunk(uint32_t first){
+		auto it = chunks.find(first);
+		if (it == chunks.end()) return;
+		dropStructure(it->second);
+		chunks.erase(it);
+		changed = true;
+	}
+
+	void VoxelRayTracer::resizeChunk(uint32_t first, uint32_t count){
+		auto it = chunks.find(first);
+		if (it == chunks.end()) return;
+		it->second.count = count;
+		it->second.dirty = true;
+	}
+
+	void VoxelRayTracer::moveChunk(uint32_t from, uint32_t to){
+		// the structure is kept so its memory is reused, the AABBs arriving at the new slots rebuild it
+		auto node = chunks.extract(from);
+		if (node.empty()) return;
+		node.key() = to;
+		node.mapped().dirty = true;
+		chunks.insert(std::move(node));
+		changed = true;
+	}
+
+	void VoxelRayTracer::clearChunks(){
+		for (auto& [first, chunk] : chunks)
+			dropStructure(chunk);
+		chunks.clear();
+		changed = true;
+	}
+
+	void VoxelRayTracer::markDirty(uint32_t first, uint32_t count){
+		if (!dirtyAabbs.empty() && dirtyAabbs.back().first + dirtyAabbs.back().count == first)
+			dirtyAabbs.back().count += count;
+		else
+			dirtyAabbs.push_back({ first, count });
+
+		// start at the chunk containing first, copies are coalesced and may span several chunks
+		auto it = chunks.upper_bound(first);
+		if (it != chunks.begin()) --it;
+		for (; it != chunks.end() && it->first < first + count; ++it)
+			if (it->first + it->second.count > first)
+				it->second.dirty = true;
+	}
+
+	void VoxelRayTracer::writeAabbs(VkCommandBuffer commandBuffer){
+		if (dirtyAabbs.empty()) return;
+
+		// the previous frame's builds may still be reading the AABBs about to be rewritten
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, aabbPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, aabbPipelineLayout, 0, 1, &aabbDescriptorSet, 0, nullptr);
+		for (auto& range : dirtyAabbs) {
+			vkCmdPushConstants(commandBuffer, aabbPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AabbRange), &range);
+			vkCmdDispatch(commandBuffer, (range.count + AABBGROUP - 1) / AABBGROUP, 1, 1);
+		}
+		dirtyAabbs.clear();
+
+		// builds read their geometry as shader reads
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void VoxelRayTracer::buildAccelerationStructures(VkCommandBuffer commandBuffer, int frameIndex){
+		writeAabbs(commandBuffer);
+
+		std::vector<std::pair<const uint32_t, ChunkAS>*> dirty{};
+		std::vector<std::pair<const uint32_t, ChunkAS>*> settled{};//unchanged long enough to be compacted
+		for (auto& chunk : chunks) {
+			if (!chunk.second.dirty) {
+				if (chunk.second.age < COMPACTAGE) chunk.second.age++;
+				else if (chunk.second.fullSize == 0 && !chunk.second.compacting && chunk.second.blas.handle != VK_NULL_HANDLE && settled.size() < COMPACTBATCH)
+					settled.push_back(&chunk);
+				continue;
+			}
+			chunk.second.dirty = false;
+			if (chunk.second.count > 0) {
+				resetCompaction(chunk.second);
+				dirty.push_back(&chunk);
+			}
+			else {
+				dropStructure(chunk.second);
+				changed = true;
+			}
+		}
+		blasBuilds = static_cast<uint32_t>(dirty.size());
+		if (dirty.empty() && !changed && settled.empty() && compactions[frameIndex].empty()) return;
+
+		// earlier frames may still be tracing the structures rebuilt in place below, a refit also reads the last build
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+			.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		const bool compacted = compactChunks(commandBuffer, frameIndex);
+		queryCompactedSizes(commandBuffer, frameIndex, settled);
+
+		if (!dirty.empty()) {
+			std::vector<VkAccelerationStructureGeometryKHR> geometries(dirty.size());
+			std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(dirty.size());
+			std::vector<VkAccelerationStructureBuildRangeInfoKHR> rangeInfos(dirty.size());
+			std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> rangeInfoPointers(dirty.size());
+			std::vector<VkDeviceSize> scratchOffsets(dirty.size());
+			const VkDeviceSize alignment = accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment;
+			VkDeviceSize batchScratch = 0;
+
+			for (size_t i = 0; i < dirty.size(); i++) {
+				auto& [first, chunk] = *dirty[i];
+				// the chunk's AABBs are its slice of the per slot AABB buffer, so primitive i is slot first + i
+				geometries[i] = {
+					.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+					.geometryType = VK_GEOMETRY_TYPE_AABBS_KHR,
+					.geometry = {.aabbs = {
+						.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR,
+						.data = {.deviceAddress = aabbAddress + first * sizeof(AABB) },
+						.stride = sizeof(AABB)
+					} },
+					.flags = VK_GEOMETRY_OPAQUE_BIT_KHR
+				};
+				buildInfos[i] = {
+					.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+					.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+					.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR,
+					.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+					.geometryCount = 1,
+					.pGeometries = &geometries[i]
+				};
+
+				VkAccelerationStructureBuildSizesInfoKHR sizes{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+				vkGetAccelerationStructureBuildSizesKHR(device.getVkDevice(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfos[i], &chunk.count, &sizes);
+				// rebuilt in place while it is big enough, a new structure also moves the chunk in the top level
+				if (chunk.blas.size < sizes.accelerationStructureSize) {
+					retire(chunk.blas);
+					createAccelerationStructure(chunk.blas, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizes);
+				}
+				buildInfos[i].dstAccelerationStructure = chunk.blas.handle;
+
+				// every build in one call needs scratch memory of its own
+				scratchOffsets[i] = batchScratch;
+				batchScratch += (sizes.buildScratchSize + alignment - 1) & ~(alignment - 1);
+				rangeInfos[i] = { .primitiveCount = chunk.count };
+				rangeInfoPointers[i] = &rangeInfos[i];
+			}
+
+			const uint64_t scratchAddress = reserveScratch(batchScratch);
+			for (size_t i = 0; i < dirty.size(); i++)
+				buildInfos[i].scratchData.deviceAddress = scratchAddress + scratchOffsets[i];
+
+			vkCmdBuildAccelerationStructuresKHR(commandBuffer, static_cast<uint32_t>(buildInfos.size()), buildInfos.data(), rangeInfoPointers.data());
+		}
+		// nothing but size queries this frame
+		if (dirty.empty() && !changed) return;
+
+		if (!dirty.empty() || compacted) {
+			// the top level build reads the bounds of the chunks just built or copied and reuses their scratch memory
+			barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+			barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+				VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		buildTopLevelAS(commandBuffer, frameIndex);
+		changed = false;
+
+		barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+			VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	bool VoxelRayTracer::compactChunks(VkCommandBuffer commandBuffer, int frameIndex){
+		auto& queried = compactions[frameIndex];
+		if (queried.empty()) return false;
+
+		// the slot's fence has been waited on, so the results are there without waiting for them
+		std::vector<VkDeviceSize> sizes(queried.size());
+		const VkResult result = vkGetQueryPoolResults(device.getVkDevice(), compactionQueries, frameIndex * COMPACTBATCH, static_cast<uint32_t>(queried.size()),
+			sizes.size() * sizeof(VkDeviceSize), sizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT);
+
+		bool copied = false;
+		for (size_t i = 0; i < queried.size(); i++) {
+			auto it = chunks.find(queried[i].first);
+			if (it == chunks.end()) continue;
+			ChunkAS& chunk = it->second;
+			// rebuilt or moved since, it is queried again once it has settled
+			if (!chunk.compacting || chunk.blas.handle != queried[i].handle) continue;
+			chunk.compacting = false;
+			if (result != VK_SUCCESS) continue;
+
+			const VkDeviceSize fullSize = chunk.blas.size;
+			if (sizes[i] > 0 && sizes[i] < fullSize) {
+				VkAccelerationStructureBuildSizesInfoKHR compactSize{
+					.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+					.accelerationStructureSize = sizes[i]
+				};
+				AccelerationStructure compact{};
+				createAccelerationStructure(compact, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compactSize);
+				VkCopyAccelerationStructureInfoKHR copyInfo{
+					.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+					.src = chunk.blas.handle,
+					.dst = compact.handle,
+					.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR
+				};
+				vkCmdCopyAccelerationStructureKHR(commandBuffer, &copyInfo);
+				// the top level is refitted onto the copy
+				retire(chunk.blas);
+				chunk.blas = compact;
+				changed = true;
+				copied = true;
+			}
+			// counted even when nothing was saved, so it is not queried again
+			chunk.fullSize = fullSize;
+			compactedChunks++;
+			compactedFrom += fullSize;
+			compactedTo += chunk.blas.size;
+		}
+		queried.clear();
+		return copied;
+	}
+
+	void VoxelRayTracer::queryCompactedSizes(VkCommandBuffer commandBuffer, int frameIndex, const std::vector<std::pair<const uint32_t, ChunkAS>*>& candidates){
+		if (candidates.empty()) return;
+		std::vector<VkAccelerationStructureKHR> handles{};
+		for (auto* candidate : candidates) {
+			candidate->second.compacting = true;
+			handles.push_back(candidate->second.blas.handle);
+			compactions[frameIndex].push_back(Compaction{ .first = candidate->first, .handle = candidate->second.blas.handle });
+		}
+		vkCmdResetQueryPool(commandBuffer, compactionQueries, frameIndex * COMPACTBATCH, COMPACTBATCH);
+		vkCmdWriteAccelerationStructuresPropertiesKHR(commandBuffer, static_cast<uint32_t>(handles.size()), handles.data(),
+			VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, compactionQueries, frameIndex * COMPACTBATCH);
+	}
+
+	void VoxelRayTracer::buildTopLevelAS(VkCommandBuffer commandBuffer, int frameIndex){
+		size_t unplaced = 0;
+		for (auto& [first, chunk] : chunks)
+			if (chunk.blas.handle != VK_NULL_HANDLE && chunk.instance == NOINSTANCE) unplaced++;
+
+		// a refit keeps the record count of the last build, new chunks have to fit into records freed since,
+		// past CHUNKMAX the chunks left out wait for the next periodic build
+		const bool build = !built || refits >= REFITMAX || (unplaced > freeInstances.size() && instanceCount < CHUNKMAX);
+		if (build) {
+			freeInstances.clear();
+			instanceCount = 0;
+			for (auto& [first, chunk] : chunks) {
+				chunk.instance = NOINSTANCE;
+				if (chunk.blas.handle != VK_NULL_HANDLE && instanceCount < CHUNKMAX)
+					chunk.instance = instanceCount++;
+			}
+			built = true;
+			refits = 0;
+			tlasBuilds++;
+		}
+		else {
+			for (auto& [first, chunk] : chunks) {
+				if (chunk.blas.handle == VK_NULL_HANDLE || chunk.instance != NOINSTANCE || freeInstances.empty()) continue;
+				chunk.instance = freeInstances.back();
+				freeInstances.pop_back();
+			}
+			refits++;
+			tlasRefits++;
+		}
+
+		// this frame's partition is free again, the frame that used it last has finished
+		auto* records = static_cast<VkAccelerationStructureInstanceKHR*>(topLevelInstances->getMappedMemory()) + frameIndex * CHUNKMAX;
+		// the AABBs are in world space already
+		const VkTransformMatrixKHR identity = {
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f };
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			VkAccelerationStructureInstanceKHR& record = records[i];
+			record.transform = identity;
+			record.instanceCustomIndex = 0;
+			record.mask = 0;
+			record.instanceShaderBindingTableRecordOffset = 0;
+			record.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+			record.accelerationStructureReference = emptyAS.deviceAddress;
+		}
+		for (auto& [first, chunk] : chunks) {
+			if (chunk.instance == NOINSTANCE) continue;
+			VkAccelerationStructureInstanceKHR& record = records[chunk.instance];
+			record.instanceCustomIndex = first;
+			record.mask = 0xFF;
+			record.accelerationStructureReference = chunk.blas.deviceAddress;
+		}
 
 		VkAccelerationStructureGeometryKHR accelerationStructureGeometry{};
 		accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
@@ -449,73 +783,68 @@ namespace vc{
 		accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
 		accelerationStructureGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
 		accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
-		accelerationStructureGeometry.geometry.instances.data = instanceDataDeviceAddress;                                                                                                                                                                                                          
-		// Get size info
-		/*
-		The pSrcAccelerationStructure, dstAccelerationStructure, and mode members of pBuildInfo are ignored. Any VkDeviceOrHostAddressKHR members of pBuildInfo are ignored by this command, except that the hostAddress member of VkAccelerationStructureGeometryTrianglesDataKHR::transformData will be examined to check if it is NULL.*
-		*/
-		VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo{};
-		accelerationStructureBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-		accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-		accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-		accelerationStructureBuildGeometryInfo.geometryCount = 1;
-		accelerationStructureBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-
-		uint32_t primitive_count = 1;
-
-		VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo{};
-		accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-		vkGetAccelerationStructureBuildSizesKHR(
-			device.getVkDevice(),
-			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-			&accelerationStructureBuildGeometryInfo,
-			&primitive_count,
-			&accelerationStructureBuildSizesInfo);
-
-		createAccelerationStructure(topLevelAS, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, accelerationStructureBuildSizesInfo);
-
-		VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
-		accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-		accelerationStructureCreateInfo.buffer = topLevelAS.buffer;
-		accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
-		accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-		vkCreateAccelerationStructureKHR(device.getVkDevice(), &accelerationStructureCreateInfo, nullptr, &topLevelAS.handle);
-
-		// Create a small scratch buffer used during build of the top level acceleration structure
-		ScratchBuffer scratchBuffer = createScratchBuffer(accelerationStructureBuildSizesInfo.buildScratchSize);
+		accelerationStructureGeometry.geometry.instances.data.deviceAddress =
+			getBufferDeviceAddress(topLevelInstances->getVkBuffer()) + frameIndex * CHUNKMAX * sizeof(VkAccelerationStructureInstanceKHR);
 
 		VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo{};
 		accelerationBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
 		accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-		accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-		accelerationBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+		accelerationBuildGeometryInfo.mode = build ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+		// refits are done in place
+		accelerationBuildGeometryInfo.srcAccelerationStructure = build ? VK_NULL_HANDLE : topLevelAS.handle;
 		accelerationBuildGeometryInfo.dstAccelerationStructure = topLevelAS.handle;
 		accelerationBuildGeometryInfo.geometryCount = 1;
 		accelerationBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-		accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
+		accelerationBuildGeometryInfo.scratchData.deviceAddress = scratch.deviceAddress;
 
 		VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
-		accelerationStructureBuildRangeInfo.primitiveCount = 1;
-		accelerationStructureBuildRangeInfo.primitiveOffset = 0;
-		accelerationStructureBuildRangeInfo.firstVertex = 0;
-		accelerationStructureBuildRangeInfo.transformOffset = 0;
-		std::vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfos = { &accelerationStructureBuildRangeInfo };
-
-
-		VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
-		vkCmdBuildAccelerationStructuresKHR(
-			commandBuffer,
-			1,
-			&accelerationBuildGeometryInfo,
-			accelerationBuildStructureRangeInfos.data());
-		device.endSingleTimeCommands(commandBuffer);
+		accelerationStructureBuildRangeInfo.primitiveCount = instanceCount;
+		const VkAccelerationStructureBuildRangeInfoKHR* accelerationBuildStructureRangeInfo = &accelerationStructureBuildRangeInfo;
+		vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &accelerationBuildGeometryInfo, &accelerationBuildStructureRangeInfo);
+	}
 
-		VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
-		accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-		accelerationDeviceAddressInfo.accelerationStructure = topLevelAS.handle;
-		topLevelAS.deviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device.getVkDevice(), &accelerationDeviceAddressInfo);
+	void VoxelRayTracer::createAabbPipeline(Buffer& iBuffer, Buffer& oBuffer, Buffer& aabbBuffer){
+		aabbSetLayout = DescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.build();
+		aabbDescriptorPool = DescriptorPool::Builder(device)
+			.setMaxSets(1)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3)
+			.build();
+		// the buffers never change, so the set is written once
+		auto instanceInfo = iBuffer.descriptorInfo();
+		auto originInfo = oBuffer.descriptorInfo();
+		auto aabbInfo = aabbBuffer.descriptorInfo();
+		DescriptorWriter(*aabbSetLayout, *aabbDescriptorPool)
+			.writeBuffer(0, &instanceInfo)
+			.writeBuffer(1, &originInfo)
+			.writeBuffer(2, &aabbInfo)
+			.build(aabbDescriptorSet);
+
+		VkPushConstantRange pushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(AabbRange)
+		};
+		VkDescriptorSetLayout layout = aabbSetLayout->getDescriptorSetLayout();
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &pushConstantRange
+		};
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device.getVkDevice(), &pipelineLayoutCreateInfo, nullptr, &aabbPipelineLayout));
 
-		deleteScratchBuffer(scratchBuffer);
+		VkComputePipelineCreateInfo pipelineCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = loadShader("shaders/aabb.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+			.layout = aabbPipelineLayout
+		};
+		VK_CHECK_RESULT(vkCreateComputePipelines(device.getVkDevice(), VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &aabbPipeline));
 	}
 
 	void VoxelRayTracer::createRayTracingPipeline() {
@@ -525,6 +854,7 @@ namespace vc{
 			.addBinding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR)
 			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,  VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_INTERSECTION_BIT_KHR)
 			.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,  VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR )
+			.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,  VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_INTERSECTION_BIT_KHR)
 			.build();
 		std::vector<VkDescriptorSetLayout> setLayouts{ setLayout->getDescriptorSetLayout() };
 		VkPipelineLayoutCreateInfo pPipelineLayoutCI{
@@ -612,50 +942,6 @@ namespace vc{
 		memcpy(shaderBindingTables.hit->getMappedMemory(), shaderHandleStorage.data() + handleSizeAligned * 2, handleSize);
 	}
 
-	VkAccelerationStructureInstanceKHR VoxelRayTracer::createInstance(obj::Voxel::Instance& instance){
-		const float c3 = cos(instance.rotation.z);
-		const float s3 = sin(instance.rotation.z);
-		const float c2 = cos(instance.rotation.x);
-		const float s2 = sin(instance.rotation.x);
-		const float c1 = cos(instance.rotation.y);
-		const float s1 = sin(instance.rotation.y);
-
-		glm::mat4 transformMatrix = glm::mat4(
-			glm::vec4(
-				instance.scale.x * (c1 * c3 + s1 * s2 * s3),
-				instance.scale.x * (c2 * s3),
-				instance.scale.x * (c1 * s2 * s3 - c3 * s1),
-				0.0f
-			),
-			glm::vec4(
-				instance.scale.y * (c3 * s1 * s2 - c1 * s3),
-				instance.scale.y * (c2 * c3),
-				instance.scale.y * (c1 * c3 * s2 + s1 * s3),
-				0.0f
-			),
-			glm::vec4(
-				instance.scale.z * (c2 * s1),
-				instance.scale.z * (-s2),
-				instance.scale.z * (c1 * c2),
-				0.0f
-			),
-			glm::vec4(instance.position, 1.0f)
-		);
-
-		VkAccelerationStructureInstanceKHR asInstance{};
-		asInstance.instanceCustomIndex = 0;
-		asInstance.mask = 0xFF;
-		asInstance.instanceShaderBindingTableRecordOffset = 0;
-		asInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-		asInstance.accelerationStructureReference = bottomLevelAS.deviceAddress;
-		for (int row = 0; row < 4; ++row) {
-			for (int col = 0; col < 4; ++col) {
-				asInstance.transform.matrix[row][col] = transformMatrix[col][row];
-			}
-		}
-		return asInstance;
-	}
-
 	ScratchBuffer VoxelRayTracer::createScratchBuffer(VkDeviceSize size){
 		ScratchBuffer scratchBuffer{};
 		// Buffer and memory
@@ -695,30 +981,27 @@ namespace vc{
 	}
 
 	void VoxelRayTracer::createAccelerationStructure(AccelerationStructure& accelerationStructure, VkAccelerationStructureTypeKHR type, VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo){
-		// Buffer and memory
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.size = buildSizeInfo.accelerationStructureSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-		VK_CHECK_RESULT(vkCreateBuffer(device.getVkDevice(), &bufferCreateInfo, nullptr, &accelerationStructure.buffer));
-		VkMemoryRequirements memoryRequirements{};
-		vkGetBufferMemoryRequirements(device.getVkDevice(), accelerationStructure.buffer, &memoryRequirements);
-		VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-		memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-		memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-		VkMemoryAllocateInfo memoryAllocateInfo{};
-		memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-		memoryAllocateInfo.allocationSize = memoryRequirements.size;
-		memoryAllocateInfo.memoryTypeIndex = device.findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device.getVkDevice(), &memoryAllocateInfo, nullptr, &accelerationStructure.memory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device.getVkDevice(), accelerationStructure.buffer, accelerationStructure.memory, 0));
+		// Storage out of the pool
+		accelerationStructure.allocation = pool.allocate(buildSizeInfo.accelerationStructureSize);
+		// Acceleration structure
+		VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
+		accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+		accelerationStructureCreateInfo.buffer = accelerationStructure.allocation.buffer;
+		accelerationStructureCreateInfo.offset = accelerationStructure.allocation.offset;
+		accelerationStructureCreateInfo.size = buildSizeInfo.accelerationStructureSize;
+		accelerationStructureCreateInfo.type = type;
+		VK_CHECK_RESULT(vkCreateAccelerationStructureKHR(device.getVkDevice(), &accelerationStructureCreateInfo, nullptr, &accelerationStructure.handle));
+		accelerationStructure.size = buildSizeInfo.accelerationStructureSize;
+		// AS device address
+		VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
+		accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+		accelerationDeviceAddressInfo.accelerationStructure = accelerationStructure.handle;
+		accelerationStructure.deviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device.getVkDevice(), &accelerationDeviceAddressInfo);
 	}
 
 	void VoxelRayTracer::deleteAccelerationStructure(AccelerationStructure& accelerationStructure){
-		vkFreeMemory(device.getVkDevice(), accelerationStructure.memory, nullptr);
-		vkDestroyBuffer(device.getVkDevice(), accelerationStructure.buffer, nullptr);
 		vkDestroyAccelerationStructureKHR(device.getVkDevice(), accelerationStructure.handle, nullptr);
+		pool.free(accelerationStructure.allocation);
 	}
 
 	std::unique_ptr<ShaderBindingTable> VoxelRayTracer::createShaderBindingTable(uint32_t handleCount){
@@ -785,8 +1068,10 @@ namespace vc{
 		return shaderStage;
 	}
 
-	void VoxelRayTracer::init(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer){
+	void VoxelRayTracer::init(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer, Buffer& oBuffer, Buffer& aabbBuffer){
+		accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
 		rayTracingPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+		rayTracingPipelineProperties.pNext = &accelerationStructureProperties;
 		VkPhysicalDeviceProperties2 deviceProperties2{};
 		deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
 		deviceProperties2.pNext = &rayTracingPipelineProperties;
@@ -797,14 +1082,7 @@ namespace vc{
 		deviceFeatures2.pNext = &accelerationStructureFeatures;
 		vkGetPhysicalDeviceFeatures2(device.getPhysivcalDevice(), &deviceFeatures2);
 
-		stagingBuffer = std::make_unique<Buffer>(
-			device,
-			sizeof(VkAccelerationStructureInstanceKHR),
-			1,
-			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			1
-		);
+		aabbAddress = getBufferDeviceAddress(aabbBuffer.getVkBuffer());
 
 		ubo = std::make_unique<Buffer>(
 			device,
@@ -815,18 +1093,33 @@ namespace vc{
 			device.properties.limits.minUniformBufferOffsetAlignment
 		);
 
-		createBottomLevelAS();
 		createTopLevelAS();
+		VkQueryPoolCreateInfo queryPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+			.queryCount = COMPACTBATCH * SwapChain::MAX_FRAMES_IN_FLIGHT
+		};
+		VK_CHECK_RESULT(vkCreateQueryPool(device.getVkDevice(), &queryPoolCreateInfo, nullptr, &compactionQueries));
+		createAabbPipeline(iBuffer, oBuffer, aabbBuffer);
 		createStorageImage(swapchain.getSwapChainImageFormat(),{swapchain.width(),swapchain.height(), 1});
 		createRayTracingPipeline();
 		createShaderBindingTables();
-		createDescriptorSets(swapchain,iBuffer,mBuffer);
+		createDescriptorSets(swapchain,iBuffer,mBuffer,oBuffer);
 	}
 
-	void VoxelRayTracer::render(FrameInfo info, SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer){
-		if(changed){
-			createTopLevelAS();
-			changed = false;
+	void VoxelRayTracer::render(FrameInfo info, SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer, Buffer& oBuffer){
+		// everything retired before this slot's previous frame is out of use, its fence has been waited on
+		deleteRetired(retired[info.frameIndex]);
+		retired[info.frameIndex] = std::move(released);
+		released = {};
+
+		buildAccelerationStructures(info.commandBuffer, info.frameIndex);
+		tlasTime += info.frameTime;
+		if (tlasTime >= 1.0f) {
+			tlasBuildsPerSecond = tlasBuilds;
+			tlasRefitsPerSecond = tlasRefits;
+			tlasBuilds = tlasRefits = 0;
+			tlasTime = 0.0f;
 		}
 
 		UniformBuffer data;
@@ -840,7 +1133,7 @@ namespace vc{
 		ubo->flush();
 		ubo->unmap();
 
-		createDescriptorSets(swapchain, iBuffer,  mBuffer);
+		createDescriptorSets(swapchain, iBuffer, mBuffer, oBuffer);
 
 		vkCmdBindPipeline(info.commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline);
 		vkCmdBindDescriptorSets(info.commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0,1,&descriptorSet,0,nullptr);
@@ -1,7 +1,10 @@
 #pragma once
+#include <array>
+#include <map>
 #include <memory>
 #include <glm/vec3.hpp>
 
+#include "AccelerationStructurePool.h"
 #include "Buffer.h"
 #include "Descriptor.h"
 #include "Device.h"
@@ -24,12 +27,13 @@ namespace vc {
 	};
 
 	struct AccelerationStructure {
-		VkAccelerationStructureKHR handle;
+		VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
 		uint64_t deviceAddress = 0;
-		VkDeviceMemory memory;
-		VkBuffer buffer;
+		AccelerationStructurePool::Allocation allocation{};
+		VkDeviceSize size = 0;
 	};
 
+	// laid out like VkAabbPositionsKHR, a NaN min.x makes the primitive inactive
 	struct AABB {
 		glm::vec3 min;
 		glm::vec3 max;
@@ -49,7 +53,41 @@ namespace vc {
 
 
 	class VoxelRayTracer{
+		static constexpr uint32_t CHUNKMAX = 1 << 14;//top level instances, one per chunk
+		static constexpr uint32_t NOINSTANCE = UINT32_MAX;
+		static constexpr uint32_t REFITMAX = 120;//refits before a full build restores the top level's trace quality
+		static constexpr uint32_t COMPACTAGE = 120;//frames a chunk has to stay unchanged before it is compacted
+		static constexpr uint32_t COMPACTBATCH = 64;//compacted size queries per frame
+		static constexpr uint32_t AABBGROUP = 64;//local size of shaders/aabb.comp
+
+		// one bottom level structure per chunk over its range of instance slots, primitive i is slot first + i
+		struct ChunkAS {
+			uint32_t count;
+			AccelerationStructure blas{};
+			bool dirty = true;
+			uint32_t instance = NOINSTANCE;//record in the top level, kept until the chunk goes away
+			uint32_t age = 0;//frames since the last build
+			bool compacting = false;//its compacted size is being queried
+			VkDeviceSize fullSize = 0;//size before compaction, 0 while it is not compacted
+		};
+		// a compacted size query, read back once the frame that wrote it has finished
+		struct Compaction {
+			uint32_t first;
+			VkAccelerationStructureKHR handle;
+		};
+		// push constants of shaders/aabb.comp
+		struct AabbRange {
+			uint32_t first;
+			uint32_t count;
+		};
+		// released once the frame that last used them has finished
+		struct Retired {
+			std::vector<AccelerationStructure> structures{};
+			std::vector<ScratchBuffer> scratch{};
+		};
+
 		VkPhysicalDeviceRayTracingPipelinePropertiesKHR  rayTracingPipelineProperties{};
+		VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
 		VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
 
 		// Enabled features and properties
@@ -69,9 +107,45 @@ namespace vc {
 		};
 
 		Device& device;
+		AccelerationStructurePool pool{ device };
+		// shared by every build, a frame's builds are ordered behind the previous frame's by barriers
+		ScratchBuffer scratch{};
+		VkDeviceSize scratchSize = 0;//largest set of builds recorded together so far
 
-		AccelerationStructure bottomLevelAS{};
+		std::map<uint32_t, ChunkAS> chunks{};//first instance slot -> structure
 		AccelerationStructure topLevelAS{};
+		std::unique_ptr<Buffer> topLevelInstances;//a partition of CHUNKMAX records per frame in flight
+		// an update has to see as many records as the build it refits, records of removed chunks stay behind
+		// pointing at this empty structure with a zero mask until the next full build packs them
+		AccelerationStructure emptyAS{};
+		std::vector<uint32_t> freeInstances{};
+		uint32_t instanceCount = 0;//records in the last full build
+		uint32_t refits = 0;//since the last full build
+		bool built = false;
+		Retired released{};//dropped since the last frame started
+		std::array<Retired, SwapChain::MAX_FRAMES_IN_FLIGHT> retired{};//per frame slot, freed when the slot comes round again
+		uint64_t aabbAddress = 0;
+		uint32_t blasBuilds = 0;//chunks rebuilt by the last frame
+
+		// the AABBs of dirty slots are written on the device from the instance and origin buffers
+		std::vector<AabbRange> dirtyAabbs{};
+		std::unique_ptr<DescriptorPool> aabbDescriptorPool{};
+		std::unique_ptr<DescriptorSetLayout> aabbSetLayout{};
+		VkDescriptorSet aabbDescriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout aabbPipelineLayout = VK_NULL_HANDLE;
+		VkPipeline aabbPipeline = VK_NULL_HANDLE;
+
+		VkQueryPool compactionQueries = VK_NULL_HANDLE;//COMPACTBATCH queries per frame in flight
+		std::array<std::vector<Compaction>, SwapChain::MAX_FRAMES_IN_FLIGHT> compactions{};
+		uint32_t compactedChunks = 0;
+		VkDeviceSize compactedFrom = 0;//sizes of the compacted chunks before and after compaction
+		VkDeviceSize compactedTo = 0;
+		// top level builds and refits, counted over a second
+		uint32_t tlasBuilds = 0;
+		uint32_t tlasRefits = 0;
+		float tlasTime = 0.0f;
+		uint32_t tlasBuildsPerSecond = 0;
+		uint32_t tlasRefitsPerSecond = 0;
 
 		std::vector<VkRayTracingShaderGroupCreateInfoKHR> shaderGroups{};
 		std::vector<VkShaderModule> shaderModules{};
@@ -103,22 +177,34 @@ namespace vc {
 			float lightIntensity;
 		};
 
-		std::unique_ptr<Buffer> stagingBuffer;
-
-		const int INSTANCEMAX = 1000000;
-		int instanceCount = 0;
-		bool changed = false;
+		bool changed = false;//the top level structure is out of date
 
 		VkPipeline pipeline;
 		VkPipelineLayout pipelineLayout;
 
 		void enableExtension();
-		void createBottomLevelAS();
 		void createTopLevelAS();
+		void createEmptyAS();
+		void createAabbPipeline(Buffer& iBuffer, Buffer& oBuffer, Buffer& aabbBuffer);
+		// records the dispatches that rewrite the AABBs of the dirty slots
+		void writeAabbs(VkCommandBuffer commandBuffer);
+		// records the builds of every dirty chunk and of the top level structure into the frame's command buffer
+		void buildAccelerationStructures(VkCommandBuffer commandBuffer, int frameIndex);
+		void buildTopLevelAS(VkCommandBuffer commandBuffer, int frameIndex);
+		void retire(AccelerationStructure& accelerationStructure);
+		void releaseInstance(ChunkAS& chunk);
+		void resetCompaction(ChunkAS& chunk);
+		// the chunk no longer has a structure, from this frame on
+		void dropStructure(ChunkAS& chunk);
+		// compacts the chunks whose sizes were queried the last time this frame slot was used, true if any were
+		bool compactChunks(VkCommandBuffer commandBuffer, int frameIndex);
+		void queryCompactedSizes(VkCommandBuffer commandBuffer, int frameIndex, const std::vector<std::pair<const uint32_t, ChunkAS>*>& candidates);
+		void deleteRetired(Retired& frame);
+		// grows the shared scratch buffer to size if it is smaller and returns its address
+		uint64_t reserveScratch(VkDeviceSize size);
 		void createShaderBindingTables();
 		void createRayTracingPipeline();
-		void createDescriptorSets(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer);
-		VkAccelerationStructureInstanceKHR createInstance(obj::Voxel::Instance& instance);
+		void createDescriptorSets(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer, Buffer& oBuffer);
 
 		//helper function (in parent class)
 		ScratchBuffer createScratchBuffer(VkDeviceSize size);
@@ -137,9 +223,29 @@ namespace vc {
 		VoxelRayTracer(Device& device);
 		~VoxelRayTracer();
 
-		void init(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer);
-		void render(FrameInfo info, SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer);
-		void addInstance(obj::Voxel::Instance& instance);
+		// aabbBuffer holds one AABB per instance slot, in world space, written from iBuffer and oBuffer on the device
+		void init(SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer, Buffer& oBuffer, Buffer& aabbBuffer);
+		void render(FrameInfo info, SwapChain& swapchain, Buffer& iBuffer, Buffer& mBuffer, Buffer& oBuffer);
+
+		// chunks are the instance ranges handed out by the VisualContext, keyed by their first slot
+		void addChunk(uint32_t first, uint32_t count);
+		void removeChunk(uint32_t first);
+		void resizeChunk(uint32_t first, uint32_t count);
+		void moveChunk(uint32_t from, uint32_t to);
+		void clearChunks();
+		// these slots were rewritten on the device, their AABBs and chunks are rebuilt before the next trace
+		void markDirty(uint32_t first, uint32_t count);
+
+		size_t getChunkCount() const { return chunks.size(); }
+		uint32_t getBlasBuilds() const { return blasBuilds; }
+		VkDeviceSize getPoolUsed() const { return pool.getUsed(); }
+		VkDeviceSize getPoolReserved() const { return pool.getReserved(); }
+		VkDeviceSize getScratchSize() const { return scratchSize; }
+		uint32_t getCompactedChunks() const { return compactedChunks; }
+		VkDeviceSize getCompactedFrom() const { return compactedFrom; }
+		VkDeviceSize getCompactedTo() const { return compactedTo; }
+		uint32_t getTlasBuildsPerSecond() const { return tlasBuildsPerSecond; }
+		uint32_t getTlasRefitsPerSecond() const { return tlasRefitsPerSecond; }
 	};
 }
 
@@ -7,7 +7,8 @@
 
 void World::loadWorld() {//load objects
   //loader.loadAround(0, 0);
-  vc.addInstance({ .position = {0.f,0.f,8.f}, .materialID = vc::Material::GREEN.getId() });
+  auto origin = vc.addOrigin({ .position = {-0.5f,-0.5f,7.5f}, .voxelSize = 1.f });
+  if (origin) vc.addInstance({ glm::ivec3{ 0 }, vc::Material::GREEN.getId(), *origin });
   //vc.addInstance({ .position = {2.f,0.f,0.f}, .materialID = vc::Material::GREEN.getId() });
   //vc.addInstance({ .position = {5.f,0.f,0.f} });
 }
@@ -19,7 +20,12 @@ void World::setup(){
   UIModule::add([this]() {
     auto pos = this->cameras[0].getPosition();
     ImGui::Text("%f %f %f",pos.x,pos.y,pos.z);
-    
+    if (target)
+      ImGui::Text("Target: %d %d %d, face %d %d %d, %.2f away", target->voxel.x, target->voxel.y, target->voxel.z,
+        target->normal.x, target->normal.y, target->normal.z, target->distance);
+    ImGui::Text("Physics: %d bodies, %d stepped, %d deferred, %.3f ms",
+      (int)physics.size(), physics.getStepped(), physics.getDeferred(), physics.getStepTime());
+    ImGui::Checkbox("Walk", &walking);
   });
 }
 
@@ -28,6 +34,7 @@ void World::configureControl(){
   camera->setPosition({ 0.f,-0.5f,0.f });
   vc.setCamera(camera->getCamera());
   camController = ic::FPMovementController(camera,camera);
+  player = physics.add({ .position = camera->getPosition() - eye, .gravity = false });
 
   ic::InputModule::addMouseListener(&camController);
   ic::InputModule::addKeyListener(GLFW_KEY_W, &camController);
@@ -55,6 +62,23 @@ void World::configureControl(){
 }
 
 
+void World::followPlayer(glm::vec3 moved, float delta){
+  auto& body = physics.get(player);
+  body.gravity = walking;
+  if (!walking) {//the body waits wherever the camera flies to
+    body.position = cameras[0].getPosition() - eye;
+    body.velocity = glm::vec3{ 0.f };
+    return;
+  }
+  // the controller moved the camera freely, its horizontal part becomes the body's velocity and up jumps (y points down)
+  if (delta > 0) {
+    body.velocity.x = moved.x / delta;
+    body.velocity.z = moved.z / delta;
+  }
+  if (moved.y < 0 && body.grounded) body.velocity.y = -jumpSpeed;
+  cameras[0].setPosition(body.position + eye);
+}
+
 void World::run() {
   while (!vc.getWindow().shouldClose()) {
     glfwPollEvents();
@@ -62,8 +86,15 @@ void World::run() {
     std::chrono::duration<float> delta = now - last;
     last = now;
     
+    glm::vec3 before = cameras[0].getPosition();
     Updatable::updateAll(delta.count());
-    //loader.loadAround(cameras[0].getPosition().x, cameras[0].getPosition().z);
+    followPlayer(cameras[0].getPosition() - before, delta.count());
+    loader.loadAround(cameras[0].getPosition(), cameras[0].getCamera()->getFrustum());
+    loader.integrate(integrationBudget);
+    // same forward axis as the view matrix built in Camera::setRotation
+    glm::vec3 rotation = cameras[0].getRotation();
+    glm::vec3 forward{ std::sin(rotation.y)*std::cos(rotation.x), -std::sin(rotation.x), std::cos(rotation.y)*std::cos(rotation.x) };
+    target = loader.raycast(cameras[0].getPosition(), forward, reach);
     vc.renderFrame();
   }
 };
\ No newline at end of file
@@ -1,11 +1,13 @@
 #pragma once
 #include <vector>
 #include <chrono>
+#include <optional>
 
 #include "CameraObject.h"
 #include "ChunkLoader.h"
 #include "CursorToggleController.h"
 #include "FPMovementController.h"
+#include "PhysicsController.h"
 #include "VisualContext.h"
 
 class World {
@@ -13,17 +15,37 @@ class World {
 	ic::FPMovementController camController{nullptr, nullptr};
 	ic::CursorToggleController cursorController{vc.getWindow().getGlWindow()};
 	
-	ChunkLoader loader{ vc };
+	const int seed = 3241561;
+	const float integrationBudget = 2.f;//ms per frame spent moving generated chunks into vc
+	const float reach = 4.f;//how far away the targeted voxel can be
+	const float physicsBudget = 1.f;//ms per frame spent moving bodies
+	const glm::vec3 eye{ 0.f, -0.7f, 0.f };//camera position relative to the centre of the player body
+	const float jumpSpeed = 6.f;
+
+	ChunkLoader loader{ vc, seed };
+	ic::PhysicsController physics{ loader, physicsBudget };
 	std::vector<obj::Camera> cameras{};
+	std::optional<ChunkLoader::Hit> target{};//voxel the camera looks at
+	size_t player = 0;//body the camera rides on while walking
+	bool walking = false;//false flies the camera through the voxels
 	
 	std::chrono::steady_clock::time_point last;
-
-	const int seed = 3241561;
 	
 	void loadWorld();
 	void configureControl();
+	//moved is how far the movement controller took the camera this frame
+	void followPlayer(glm::vec3 moved, float delta);
 public:
 	void setup();
 	void run();
+
+	//voxel coordinates are world position / voxel size, edits show up at the next frame
+	uint32_t getVoxel(glm::ivec3 voxel) { return loader.getVoxel(voxel); }
+	bool setVoxel(glm::ivec3 voxel, uint32_t material) { return loader.setVoxel(voxel, material); }
+	int fillBox(glm::ivec3 min, glm::ivec3 max, uint32_t material) { return loader.fillBox(min, max, material); }
+	int carveSphere(glm::vec3 center, float radius) { return loader.carveSphere(center, radius); }
+	std::optional<ChunkLoader::Hit> raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) { return loader.raycast(origin, direction, maxDistance); }
+	//bodies collide with the loaded voxels and fall under gravity, they are stepped with the other Updatables
+	ic::PhysicsController& getPhysics() { return physics; }
 };
 
@@ -1,10 +1,15 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <iostream>
+#include <string>
 
+#include "Benchmark.h"
 #include "World.h"
 
-int main(){
+int main(int argc, char* argv[]){
+	if (argc > 1 && std::string(argv[1]) == "--bench")
+		return Benchmark::run(argc > 2 ? argv[2] : "");
+
 	try {
 		World world{};
 		world.setup();